@@ -0,0 +1,90 @@
+/* ------------------------------------------------------------------------
+   bench_fair.c
+
+   Runs CPU hogs at each of the priorities 1 to 5 for a fixed time, under
+   SCHED_FIXED and then SCHED_FAIR, and reports the CPU each priority got.
+   Fixed priorities give everything to priority 1, the fair policy should
+   split it roughly by weight, 1.5 times as much per step up.  The run
+   with several hogs per priority shows the split holds with a larger run
+   queue.
+
+   Prints one line per run:
+       bench=fair policy=<fixed|fair> hogs=<n> p1_us=<cpu> ... p5_us=<cpu>
+   ------------------------------------------------------------------------ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <usloss.h>
+#include <phase1.h>
+
+#define PRIORITIES  5
+#define RUNTIME     3000000 /* microseconds the hogs run for */
+#define QUANTUM     20000   /* short slices so shares even out quickly */
+
+volatile int done;
+long long cpu[PRIORITIES + 1];
+
+int hog(char *arg)
+{
+    while (!done)
+        ;
+
+    cpu[atoi(arg)] += readtime();
+    return 0;
+} /* hog */
+
+
+int timer(char *arg)
+{
+    int start = USLOSS_Clock();
+
+    while (USLOSS_Clock() - start < RUNTIME)
+        ;
+
+    done = 1;
+    return 0;
+} /* timer */
+
+
+void run(int policy, char *name, int perPriority)
+{
+    int i, p, status;
+    char buf[10];
+
+    setSchedPolicy(policy);
+    done = 0;
+    for (p = 1; p <= PRIORITIES; p++) {
+        cpu[p] = 0;
+    }
+
+    // the timer runs at the top priority so it is never starved
+    fork1("timer", timer, NULL, USLOSS_MIN_STACK, 1);
+
+    for (i = 0; i < perPriority; i++) {
+        for (p = 1; p <= PRIORITIES; p++) {
+            sprintf(buf, "%d", p);
+            fork1("hog", hog, buf, USLOSS_MIN_STACK, p);
+        }
+    }
+
+    for (i = 0; i < perPriority * PRIORITIES + 1; i++) {
+        join(&status);
+    }
+
+    USLOSS_Console("bench=fair policy=%s hogs=%d p1_us=%lld p2_us=%lld "
+                   "p3_us=%lld p4_us=%lld p5_us=%lld\n",
+                   name, perPriority * PRIORITIES, cpu[1], cpu[2], cpu[3],
+                   cpu[4], cpu[5]);
+} /* run */
+
+
+int start1(char *arg)
+{
+    setTimeSlice(QUANTUM);
+
+    run(SCHED_FIXED, "fixed", 1);
+    run(SCHED_FAIR, "fair", 1);
+    run(SCHED_FAIR, "fair", 10);
+
+    return 0;
+} /* start1 */
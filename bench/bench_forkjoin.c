@@ -0,0 +1,59 @@
+/* ------------------------------------------------------------------------
+   bench_forkjoin.c
+
+   Forks a batch of children, then joins all of them, for batches of
+   growing size.  The process table has to grow to hold each batch, so
+   per-fork and per-join cost staying flat across batch sizes shows that
+   growing the table does not slow down fork1 or join.  The children
+   are below start1's priority, so every fork should skip the dispatcher.
+
+   Prints one line per batch:
+       bench=forkjoin live=<children> fork_us=<avg> join_us=<avg>
+           elided=<dispatches skipped> performed=<dispatches run>
+   ------------------------------------------------------------------------ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <phase1.h>
+
+#define MAXLIVE 10000
+
+int child(char *arg)
+{
+    return 0;
+} /* child */
+
+
+int start1(char *arg)
+{
+    int live, i, status, start, forked, joined;
+    int elided, performed, start_elided, start_performed;
+
+    setProcLimit(MAXLIVE + 2);
+
+    for (live = 10; live <= MAXLIVE; live *= 10) {
+        readDispatchStats(&start_elided, &start_performed);
+        start = USLOSS_Clock();
+        for (i = 0; i < live; i++) {
+            if (fork1("child", child, NULL, USLOSS_MIN_STACK, 5) < 0) {
+                USLOSS_Console("bench_forkjoin: fork1 failed at %d\n", i);
+                USLOSS_Halt(1);
+            }
+        }
+        forked = USLOSS_Clock() - start;
+        readDispatchStats(&elided, &performed);
+
+        start = USLOSS_Clock();
+        for (i = 0; i < live; i++) {
+            join(&status);
+        }
+        joined = USLOSS_Clock() - start;
+
+        USLOSS_Console("bench=forkjoin live=%d fork_us=%.3f join_us=%.3f "
+                       "elided=%d performed=%d\n", live,
+                       (double) forked / live, (double) joined / live,
+                       elided - start_elided, performed - start_performed);
+    }
+
+    return 0;
+} /* start1 */
@@ -0,0 +1,77 @@
+/* ------------------------------------------------------------------------
+   bench_inherit.c
+
+   Measures how long zap takes when the zapped process has a lower
+   priority than other busy processes.  start1 (priority 1) zaps a
+   priority 5 victim that needs VICTIMWORK microseconds to finish, while
+   HOGS priority 3 processes each want HOGWORK microseconds of CPU.
+   Without priority inheritance the victim waits for every hog.  With it,
+   the victim runs at start1's priority and the zap completes in about
+   VICTIMWORK.
+
+   Prints one line per setting:
+       bench=inherit inheritance=<0|1> trials=<n> mean_zap_us=<avg>
+           max_zap_us=<worst>
+   ------------------------------------------------------------------------ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <phase1.h>
+
+#define TRIALS      3
+#define HOGS        2
+#define HOGWORK     300000
+#define VICTIMWORK  20000
+
+int spin(char *arg)
+{
+    int start = USLOSS_Clock();
+    int work = arg[0] == 'h' ? HOGWORK : VICTIMWORK;
+
+    while (USLOSS_Clock() - start < work)
+        ;
+
+    return 0;
+} /* spin */
+
+
+void run(int inherit)
+{
+    int trial, i, pid, status, start, took, worst = 0;
+    long long total = 0;
+
+    setPriorityInheritance(inherit);
+
+    for (trial = 0; trial < TRIALS; trial++) {
+        pid = fork1("victim", spin, "v", USLOSS_MIN_STACK, 5);
+        for (i = 0; i < HOGS; i++) {
+            fork1("hog", spin, "h", USLOSS_MIN_STACK, 3);
+        }
+
+        start = USLOSS_Clock();
+        zap(pid);
+        took = USLOSS_Clock() - start;
+
+        total += took;
+        if (took > worst) {
+            worst = took;
+        }
+
+        for (i = 0; i < HOGS + 1; i++) {
+            join(&status);
+        }
+    }
+
+    USLOSS_Console("bench=inherit inheritance=%d trials=%d mean_zap_us=%d "
+                   "max_zap_us=%d\n", inherit, TRIALS,
+                   (int) (total / TRIALS), worst);
+} /* run */
+
+
+int start1(char *arg)
+{
+    run(0);
+    run(1);
+
+    return 0;
+} /* start1 */
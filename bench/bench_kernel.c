@@ -0,0 +1,219 @@
+/* ------------------------------------------------------------------------
+   bench_kernel.c
+
+   Microbenchmarks of the phase1 kernel primitives:
+       dispatch   - start1 calling dispatcher() with nothing else to run
+       pingpong   - two processes waking each other with blockMe and
+                    unblockProc, two context switches per round, with
+                    the dispatcher's ReadyList picks and the entries it
+                    looked at for them
+       roundtrip  - fork1 of a child that returns at once, then join
+       zap        - zap of a process that quits as soon as it sees it is
+                    zapped
+
+   Each is run with READY idle processes queued at priority 5 and BLOCKED
+   idle processes parked in blockMe, swept over several counts, and
+   prints one line per run:
+       bench=<name> ready=<n> blocked=<n> iters=<n> ns_per_op=<ns> ...
+   ------------------------------------------------------------------------ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <usloss.h>
+#include <phase1.h>
+
+#define ITERS       2000
+#define MAXIDLE     1000
+#define BENCHBLOCK  12
+
+int sweep[] = {0, 100, MAXIDLE};
+int parked[MAXIDLE];
+int ready, blocked;
+int pingPid, pongPid, pingStart, pingEnd;
+
+void report(char *name, int elapsed, char *extra)
+{
+    USLOSS_Console("bench=%s ready=%d blocked=%d iters=%d ns_per_op=%d%s\n",
+                   name, ready, blocked, ITERS,
+                   (int) (elapsed * 1000LL / ITERS), extra);
+} /* report */
+
+
+int idle(char *arg)
+{
+    return 0;
+} /* idle */
+
+
+int sleeper(char *arg)
+{
+    blockMe(BENCHBLOCK);
+    return 0;
+} /* sleeper */
+
+
+int releaser(char *arg)
+{
+    unblockProc(atoi(arg));
+    return 0;
+} /* releaser */
+
+
+int victim(char *arg)
+{
+    while (!isZapped())
+        ;
+    return 0;
+} /* victim */
+
+
+int ping(char *arg)
+{
+    int i;
+
+    pingStart = USLOSS_Clock();
+    for (i = 0; i < ITERS; i++) {
+        unblockProc(pongPid);
+        blockMe(BENCHBLOCK);
+    }
+    pingEnd = USLOSS_Clock();
+
+    return 0;
+} /* ping */
+
+
+int pong(char *arg)
+{
+    int i;
+
+    for (i = 0; i < ITERS; i++) {
+        blockMe(BENCHBLOCK);
+        unblockProc(pingPid);
+    }
+
+    return 0;
+} /* pong */
+
+
+/*
+ * Forks the idle processes for one run.  Sleepers run and block while
+ * start1 is blocked, then the releaser, forked right after them, wakes
+ * start1 back up.
+ */
+void setup(void)
+{
+    int i, me = getpid();
+    char buf[10];
+
+    for (i = 0; i < blocked; i++) {
+        parked[i] = fork1("sleeper", sleeper, NULL, USLOSS_MIN_STACK, 4);
+    }
+
+    if (blocked > 0) {
+        sprintf(buf, "%d", me);
+        fork1("releaser", releaser, buf, USLOSS_MIN_STACK, 5);
+        blockMe(BENCHBLOCK);
+    }
+
+    for (i = 0; i < ready; i++) {
+        fork1("idle", idle, NULL, USLOSS_MIN_STACK, 5);
+    }
+} /* setup */
+
+
+void teardown(void)
+{
+    int i, status;
+
+    for (i = 0; i < blocked; i++) {
+        unblockProc(parked[i]);
+    }
+
+    while (join(&status) != -2)
+        ;
+} /* teardown */
+
+
+void benchDispatch(void)
+{
+    int i, start = USLOSS_Clock();
+
+    for (i = 0; i < ITERS; i++) {
+        dispatcher();
+    }
+
+    report("dispatch", USLOSS_Clock() - start, "");
+} /* benchDispatch */
+
+
+void benchPingPong(void)
+{
+    int status;
+    char extra[80];
+    kernelStats stats;
+
+    getKernelStats(NULL, 1);
+    pongPid = fork1("pong", pong, NULL, USLOSS_MIN_STACK, 2);
+    pingPid = fork1("ping", ping, NULL, USLOSS_MIN_STACK, 2);
+    join(&status);
+    join(&status);
+    getKernelStats(&stats, 0);
+
+    sprintf(extra, " switches_per_sec=%d picks=%d inspected=%d",
+            (int) (2LL * ITERS * 1000000 / (pingEnd - pingStart + 1)),
+            stats.readyPicks, stats.readyInspected);
+    report("pingpong", pingEnd - pingStart, extra);
+} /* benchPingPong */
+
+
+void benchRoundTrip(void)
+{
+    int i, status, start = USLOSS_Clock();
+
+    for (i = 0; i < ITERS; i++) {
+        fork1("child", idle, NULL, USLOSS_MIN_STACK, 2);
+        join(&status);
+    }
+
+    report("roundtrip", USLOSS_Clock() - start, "");
+} /* benchRoundTrip */
+
+
+void benchZap(void)
+{
+    int i, pid, status, start, elapsed = 0;
+
+    for (i = 0; i < ITERS; i++) {
+        pid = fork1("victim", victim, NULL, USLOSS_MIN_STACK, 2);
+        start = USLOSS_Clock();
+        zap(pid);
+        elapsed += USLOSS_Clock() - start;
+        join(&status);
+    }
+
+    report("zap", elapsed, "");
+} /* benchZap */
+
+
+int start1(char *arg)
+{
+    int r, b;
+
+    setProcLimit(2 * MAXIDLE + 10);
+
+    for (b = 0; b < sizeof(sweep) / sizeof(sweep[0]); b++) {
+        for (r = 0; r < sizeof(sweep) / sizeof(sweep[0]); r++) {
+            blocked = sweep[b];
+            ready = sweep[r];
+
+            setup();
+            benchDispatch();
+            benchPingPong();
+            benchRoundTrip();
+            benchZap();
+            teardown();
+        }
+    }
+
+    return 0;
+} /* start1 */
@@ -0,0 +1,196 @@
+/* ------------------------------------------------------------------------
+   bench_layout.c
+
+   Host-side benchmark, built without USLOSS, comparing the procStruct
+   layout of kernel.h with the one it replaced, where name, startArg and
+   the USLOSS_Context sat inline between the list links and status,
+   priority and pid.  Two access patterns the kernel makes are timed over
+   tables of growing size:
+       scan - every entry in table order, reading status, as the table
+              walks in checkDeadlock() and setPriorityInheritance() do
+       walk - following nextProcPtr around a ReadyList in a shuffled
+              order, reading status, priority and pid, as the dispatcher
+              and list operations do
+
+   Prints one line per layout, pattern and table size:
+       bench=layout layout=<fat|split> pattern=<scan|walk> procs=<n>
+           bytes=<sizeof entry> ns_per_proc=<avg>
+   ------------------------------------------------------------------------ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <usloss.h>
+#include <phase1.h>
+#include "kernel.h"
+
+#define MAXPROCS 100000
+#define VISITS   20000000
+
+typedef struct fatProc fatProc;
+
+/* procStruct as it was before the hot/cold split */
+struct fatProc {
+   fatProc        *heads[5];
+   fatProc        *tails[3];
+   fatProc        *nextProcPtr;
+   fatProc        *nextLinks[5];
+   fatProc        *prevLinks[6];
+   unsigned int    onLists;
+   char            name[MAXNAME];
+   char            startArg[MAXARG];
+   USLOSS_Context  state;
+   int             pid;
+   int             priority;
+   int             base_priority;
+   int             own_priority;
+   int (* startFunc) (char *);
+   char           *stack;
+   unsigned int    stackSize;
+   int             stackClass;
+   int             status;
+   int             counters[6];
+   long long       vruntime;
+   int             heapIndex;
+   fatProc        *joinTarget;
+   int             timer[4];
+   int            *zapPids;
+   int             zapCount;
+   fatProc        *waitNext;
+   int             waitMark;
+   int             waitStuck;
+};
+
+static int order[MAXPROCS];
+static volatile int sink;      /* keeps the loads from being optimized out */
+
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+} /* now_ns */
+
+
+static void shuffle(int procs)
+{
+    int i, j, tmp;
+
+    for (i = 0; i < procs; i++) {
+        order[i] = i;
+    }
+    for (i = procs - 1; i > 0; i--) {
+        j = rand() % (i + 1);
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+} /* shuffle */
+
+
+static void report(char *layout, char *pattern, int procs, int bytes,
+                   long long took, long long visits, int sum)
+{
+    printf("bench=layout layout=%s pattern=%s procs=%d bytes=%d "
+           "ns_per_proc=%.3f\n", layout, pattern, procs, bytes,
+           (double) took / visits);
+    sink = sum;
+} /* report */
+
+
+static void run_fat(int procs)
+{
+    fatProc *table = calloc(procs, sizeof(fatProc));
+    fatProc *scout;
+    long long start, visits = 0;
+    int i, sum = 0;
+
+    shuffle(procs);
+    for (i = 0; i < procs; i++) {
+        table[order[i]].nextProcPtr = &table[order[(i + 1) % procs]];
+        table[i].status = READY;
+        table[i].priority = 3;
+        table[i].pid = i;
+    }
+
+    start = now_ns();
+    while (visits < VISITS) {
+        for (i = 0; i < procs; i++) {
+            sum += table[i].status == READY;
+        }
+        visits += procs;
+    }
+    report("fat", "scan", procs, sizeof(fatProc), now_ns() - start,
+           visits, sum);
+
+    scout = &table[0];
+    start = now_ns();
+    for (visits = 0; visits < VISITS; visits++) {
+        sum += scout->status + scout->priority + scout->pid;
+        scout = scout->nextProcPtr;
+    }
+    report("fat", "walk", procs, sizeof(fatProc), now_ns() - start,
+           visits, sum);
+
+    free(table);
+} /* run_fat */
+
+
+static void run_split(int procs)
+{
+    procStruct *table;
+    procPtr scout;
+    long long start, visits = 0;
+    int i, sum = 0;
+
+    if (posix_memalign((void **) &table, CACHELINE,
+                       procs * sizeof(procStruct)) != 0) {
+        exit(1);
+    }
+    memset(table, 0, procs * sizeof(procStruct));
+
+    shuffle(procs);
+    for (i = 0; i < procs; i++) {
+        table[order[i]].nextProcPtr = &table[order[(i + 1) % procs]];
+        table[i].status = READY;
+        table[i].priority = 3;
+        table[i].pid = i;
+    }
+
+    start = now_ns();
+    while (visits < VISITS) {
+        for (i = 0; i < procs; i++) {
+            sum += table[i].status == READY;
+        }
+        visits += procs;
+    }
+    report("split", "scan", procs, sizeof(procStruct), now_ns() - start,
+           visits, sum);
+
+    scout = &table[0];
+    start = now_ns();
+    for (visits = 0; visits < VISITS; visits++) {
+        sum += scout->status + scout->priority + scout->pid;
+        scout = scout->nextProcPtr;
+    }
+    report("split", "walk", procs, sizeof(procStruct), now_ns() - start,
+           visits, sum);
+
+    free(table);
+} /* run_split */
+
+
+int main(void)
+{
+    int procs;
+
+    for (procs = MAXPROC; procs <= MAXPROCS; procs *= 10) {
+        run_fat(procs);
+        run_split(procs);
+    }
+
+    return 0;
+} /* main */
@@ -0,0 +1,99 @@
+/* ------------------------------------------------------------------------
+   bench_mlfq.c
+
+   Compares SCHED_FIXED and SCHED_MLFQ on a mixed workload.  Two CPU hogs
+   and one interactive process are all forked at priority 3.  The
+   interactive process repeatedly computes for a millisecond, then waits
+   on a short-lived child with join.  The time from the child quitting to
+   the interactive process running again is its wakeup latency.  Under
+   MLFQ the hogs sink below it, so it should be woken right away.
+
+   Prints one line per policy:
+       bench=mlfq policy=<fixed|mlfq> iters=<n> mean_wake_us=<avg>
+           max_wake_us=<max> elapsed_us=<time for all iterations>
+   ------------------------------------------------------------------------ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <phase1.h>
+
+#define HOGS    2
+#define ITERS   20
+#define BURST   1000    /* microseconds of CPU per interactive step */
+
+volatile int done;
+int quitTime, maxWake;
+long long totalWake;
+
+int hog(char *arg)
+{
+    while (!done)
+        ;
+
+    return 0;
+} /* hog */
+
+
+int request(char *arg)
+{
+    quitTime = USLOSS_Clock();
+    return 0;
+} /* request */
+
+
+int interactive(char *arg)
+{
+    int i, start, status, wake;
+
+    for (i = 0; i < ITERS; i++) {
+        start = USLOSS_Clock();
+        while (USLOSS_Clock() - start < BURST)
+            ;
+
+        fork1("request", request, NULL, USLOSS_MIN_STACK, 1);
+        join(&status);
+
+        wake = USLOSS_Clock() - quitTime;
+        totalWake += wake;
+        if (wake > maxWake) {
+            maxWake = wake;
+        }
+    }
+
+    done = 1;
+    return 0;
+} /* interactive */
+
+
+void run(int policy, char *name)
+{
+    int i, status, start;
+
+    setSchedPolicy(policy);
+    done = maxWake = 0;
+    totalWake = 0;
+
+    start = USLOSS_Clock();
+    for (i = 0; i < HOGS; i++) {
+        fork1("hog", hog, NULL, USLOSS_MIN_STACK, 3);
+    }
+    fork1("interactive", interactive, NULL, USLOSS_MIN_STACK, 3);
+
+    for (i = 0; i < HOGS + 1; i++) {
+        join(&status);
+    }
+
+    USLOSS_Console("bench=mlfq policy=%s iters=%d mean_wake_us=%d "
+                   "max_wake_us=%d elapsed_us=%d\n", name, ITERS,
+                   (int) (totalWake / ITERS), maxWake,
+                   USLOSS_Clock() - start);
+} /* run */
+
+
+int start1(char *arg)
+{
+    run(SCHED_FIXED, "fixed");
+    run(SCHED_MLFQ, "mlfq");
+
+    return 0;
+} /* start1 */
@@ -0,0 +1,160 @@
+/* ------------------------------------------------------------------------
+   bench_semaphore.c
+
+   Ping-pong between pairs of priority 3 processes, each round trip being
+   a V then a P on each side.  It is run with semaphores built the way
+   higher layers had to, out of blockMe() and unblockProc(), and with the
+   kernel's semP()/semV(), which hand the count straight to the waiter
+   and only reschedule if the waiter outranks the caller.  Time slicing
+   is off so only the semaphores cause switches.  Switches are counted
+   from the trace ring over a short run, and time over a long one.
+
+   Prints one line per method:
+       bench=semaphore method=<blockme|native> pairs=<n>
+           switches_per_round=<avg> round_us=<avg>
+   ------------------------------------------------------------------------ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <phase1.h>
+
+#define PAIRS       2
+#define COUNTROUNDS 25
+#define ROUNDS      20000
+
+typedef struct adhocSem {
+    int value;
+    int waiter;
+} adhocSem;
+
+static int native;
+static int rounds;
+static adhocSem adhoc[PAIRS][2];
+static int sems[PAIRS][2];
+
+void adhoc_p(adhocSem *sem)
+{
+    while (sem->value == 0) {
+        sem->waiter = getpid();
+        blockMe(20);
+    }
+    sem->value--;
+} /* adhoc_p */
+
+
+void adhoc_v(adhocSem *sem)
+{
+    int waiter = sem->waiter;
+
+    sem->value++;
+    if (waiter != 0) {
+        sem->waiter = 0;
+        unblockProc(waiter);
+    }
+} /* adhoc_v */
+
+
+void p(int pair, int which)
+{
+    if (native) {
+        semP(sems[pair][which]);
+    }
+    else {
+        adhoc_p(&adhoc[pair][which]);
+    }
+} /* p */
+
+
+void v(int pair, int which)
+{
+    if (native) {
+        semV(sems[pair][which]);
+    }
+    else {
+        adhoc_v(&adhoc[pair][which]);
+    }
+} /* v */
+
+
+int ping(char *arg)
+{
+    int pair = arg[0] - '0', i;
+
+    for (i = 0; i < rounds; i++) {
+        v(pair, 0);
+        p(pair, 1);
+    }
+
+    return 0;
+} /* ping */
+
+
+int pong(char *arg)
+{
+    int pair = arg[0] - '0', i;
+
+    for (i = 0; i < rounds; i++) {
+        p(pair, 0);
+        v(pair, 1);
+    }
+
+    return 0;
+} /* pong */
+
+
+void run(void)
+{
+    char arg[2] = "0";
+    int pair, status;
+
+    for (pair = 0; pair < PAIRS; pair++) {
+        arg[0] = '0' + pair;
+        fork1("ping", ping, arg, USLOSS_MIN_STACK, 3);
+        fork1("pong", pong, arg, USLOSS_MIN_STACK, 3);
+    }
+
+    for (pair = 0; pair < 2 * PAIRS; pair++) {
+        join(&status);
+    }
+} /* run */
+
+
+int start1(char *arg)
+{
+    static traceEvent events[1024];
+    int pair, start, took, i, count, switches;
+
+    setTimeSlice(0);
+
+    for (pair = 0; pair < PAIRS; pair++) {
+        sems[pair][0] = semCreate(0);
+        sems[pair][1] = semCreate(0);
+    }
+
+    for (native = 0; native <= 1; native++) {
+        rounds = COUNTROUNDS;
+        start = USLOSS_Clock();
+        run();
+
+        switches = 0;
+        count = readTrace(events, 1024);
+        for (i = 0; i < count; i++) {
+            if (events[i].type == TRACE_SWITCH && events[i].time >= start) {
+                switches++;
+            }
+        }
+
+        rounds = ROUNDS;
+        start = USLOSS_Clock();
+        run();
+        took = USLOSS_Clock() - start;
+
+        USLOSS_Console("bench=semaphore method=%s pairs=%d "
+                       "switches_per_round=%.2f round_us=%.3f\n",
+                       native ? "native" : "blockme", PAIRS,
+                       (double) switches / (PAIRS * COUNTROUNDS),
+                       (double) took / (PAIRS * ROUNDS));
+    }
+
+    return 0;
+} /* start1 */
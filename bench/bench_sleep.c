@@ -0,0 +1,64 @@
+/* ------------------------------------------------------------------------
+   bench_sleep.c
+
+   Measures the cost of a clock tick as the number of sleeping processes
+   grows.  Sleepers are spread over about 100000 ticks past the measured
+   window, so every level of the timer wheel is in use and cascades
+   happen, but none wake while the ticks are timed.  start1 drives the
+   ticks itself by calling clock_interrupt_handler(), then wakes the
+   sleepers early with unblockProc() and joins them.
+
+   Prints one line per number of sleepers:
+       bench=sleep sleepers=<n> ticks=<n> tick_us=<avg>
+   ------------------------------------------------------------------------ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <phase1.h>
+
+#define MAXSLEEPERS 10000
+#define TICKS       20000
+#define SPREAD      100000
+
+int sleeper(char *arg)
+{
+    sleepTicks(TICKS + 1 + (getpid() * 7919) % SPREAD);
+
+    return 0;
+} /* sleeper */
+
+
+int start1(char *arg)
+{
+    static int pids[MAXSLEEPERS];
+    int sleepers, i, status, start, took;
+
+    setProcLimit(MAXSLEEPERS + 2);
+
+    for (sleepers = 0; sleepers <= MAXSLEEPERS;
+         sleepers = sleepers == 0 ? 10 : sleepers * 10) {
+        // sleepers at start1's priority only run once start1 blocks
+        for (i = 0; i < sleepers; i++) {
+            pids[i] = fork1("sleeper", sleeper, NULL, USLOSS_MIN_STACK, 1);
+        }
+        sleepTicks(1);
+
+        start = USLOSS_Clock();
+        for (i = 0; i < TICKS; i++) {
+            clock_interrupt_handler(USLOSS_CLOCK_DEV, NULL);
+        }
+        took = USLOSS_Clock() - start;
+
+        for (i = 0; i < sleepers; i++) {
+            unblockProc(pids[i]);
+        }
+        for (i = 0; i < sleepers; i++) {
+            join(&status);
+        }
+
+        USLOSS_Console("bench=sleep sleepers=%d ticks=%d tick_us=%.3f\n",
+                       sleepers, TICKS, (double) took / TICKS);
+    }
+
+    return 0;
+} /* start1 */
@@ -0,0 +1,65 @@
+/* ------------------------------------------------------------------------
+   bench_tickless.c
+
+   Counts the clock interrupts that do real work with and without
+   tickless mode.  In the single workload one priority 3 process spins
+   for RUNTIME microseconds on its own.  Nothing can preempt it, so
+   tickless mode should skip nearly every tick.  In the pair workload two
+   processes share priority 3, and each tick may end a time slice, so
+   only the ticks after the first one finishes can be skipped.
+
+   Prints one line per setting and workload:
+       bench=tickless tickless=<0|1> workload=<single|pair>
+           interrupts=<n> skipped=<n> handled=<n>
+   ------------------------------------------------------------------------ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <phase1.h>
+
+#define RUNTIME 500000
+
+int spin(char *arg)
+{
+    int start = USLOSS_Clock();
+
+    while (USLOSS_Clock() - start < RUNTIME)
+        ;
+
+    return 0;
+} /* spin */
+
+
+void run(int on, int runners, char *workload)
+{
+    int i, status, interrupts, skipped, start_interrupts, start_skipped;
+
+    setTickless(on);
+    readClockStats(&start_interrupts, &start_skipped);
+
+    for (i = 0; i < runners; i++) {
+        fork1("spin", spin, NULL, USLOSS_MIN_STACK, 3);
+    }
+    for (i = 0; i < runners; i++) {
+        join(&status);
+    }
+
+    readClockStats(&interrupts, &skipped);
+    interrupts -= start_interrupts;
+    skipped -= start_skipped;
+
+    USLOSS_Console("bench=tickless tickless=%d workload=%s interrupts=%d "
+                   "skipped=%d handled=%d\n", on, workload, interrupts,
+                   skipped, interrupts - skipped);
+} /* run */
+
+
+int start1(char *arg)
+{
+    run(0, 1, "single");
+    run(1, 1, "single");
+    run(0, 2, "pair");
+    run(1, 2, "pair");
+
+    return 0;
+} /* start1 */
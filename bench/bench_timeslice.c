@@ -0,0 +1,103 @@
+/* ------------------------------------------------------------------------
+   bench_timeslice.c
+
+   Runs an interactive process at the same priority as several CPU hogs,
+   first with time slicing off and then with the default quantum.  The
+   interactive process spins in short steps and records every gap between
+   steps longer than a millisecond, which is time it spent waiting for
+   the CPU.  The delay from its fork to its first step counts as a gap.
+
+   Prints one line per run:
+       bench=timeslice quantum_us=<q> waits=<n> mean_wait_us=<avg>
+           max_wait_us=<max> first_run_us=<delay before first step>
+   ------------------------------------------------------------------------ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <phase1.h>
+
+#define HOGS        3
+#define RUNTIME     500000  /* microseconds of CPU each process uses */
+#define WAITGAP     1000    /* gaps longer than this count as waits */
+
+int forkTime, firstRun, waits, maxWait;
+long long totalWait;
+
+int hog(char *arg)
+{
+    int ran = 0, last = USLOSS_Clock(), now;
+
+    // only count short steps, long gaps are time spent preempted
+    while (ran < RUNTIME) {
+        now = USLOSS_Clock();
+        if (now - last <= WAITGAP) {
+            ran += now - last;
+        }
+        last = now;
+    }
+
+    return 0;
+} /* hog */
+
+
+int interactive(char *arg)
+{
+    int ran = 0, last = forkTime, now;
+
+    // the delay from fork to the first step is a wait like any other
+    firstRun = USLOSS_Clock() - forkTime;
+
+    while (ran < RUNTIME) {
+        now = USLOSS_Clock();
+        if (now - last <= WAITGAP) {
+            ran += now - last;
+        }
+        else {
+            waits++;
+            totalWait += now - last;
+            if (now - last > maxWait) {
+                maxWait = now - last;
+            }
+        }
+        last = now;
+    }
+
+    return 0;
+} /* interactive */
+
+
+void run(int quantum)
+{
+    int i, status;
+
+    setTimeSlice(quantum);
+    waits = maxWait = 0;
+    totalWait = 0;
+
+    for (i = 0; i < HOGS; i++) {
+        fork1("hog", hog, NULL, USLOSS_MIN_STACK, 3);
+    }
+
+    forkTime = USLOSS_Clock();
+    fork1("interactive", interactive, NULL, USLOSS_MIN_STACK, 3);
+
+    for (i = 0; i < HOGS + 1; i++) {
+        join(&status);
+    }
+
+    USLOSS_Console("bench=timeslice quantum_us=%d waits=%d mean_wait_us=%d "
+                   "max_wait_us=%d first_run_us=%d\n", quantum, waits,
+                   waits == 0 ? 0 : (int) (totalWait / waits), maxWait,
+                   firstRun);
+} /* run */
+
+
+int start1(char *arg)
+{
+    int quantum = setTimeSlice(0);
+
+    run(0);
+    run(quantum);
+
+    return 0;
+} /* start1 */
@@ -0,0 +1,72 @@
+/* ------------------------------------------------------------------------
+   bench_zapmany.c
+
+   Tears down a pool of workers with a loop of zap() calls and with one
+   zapMany() call.  The workers are forked at priority 5, below start1,
+   so none of them runs until start1 blocks.  A zap loop then blocks and
+   wakes start1 once per worker, and zapMany() blocks it only once.
+
+   Prints one line per pool size and method:
+       bench=zapmany method=<loop|batch> victims=<n> trials=<n>
+           zap_us=<avg per victim>
+   ------------------------------------------------------------------------ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <phase1.h>
+
+#define MAXVICTIMS 1000
+#define TRIALS     5
+
+int worker(char *arg)
+{
+    return 0;
+} /* worker */
+
+
+void run(int victims, int batch)
+{
+    static int pids[MAXVICTIMS];
+    int trial, i, status, start;
+    long long total = 0;
+
+    for (trial = 0; trial < TRIALS; trial++) {
+        for (i = 0; i < victims; i++) {
+            pids[i] = fork1("worker", worker, NULL, USLOSS_MIN_STACK, 5);
+        }
+
+        start = USLOSS_Clock();
+        if (batch) {
+            zapMany(pids, victims);
+        }
+        else {
+            for (i = 0; i < victims; i++) {
+                zap(pids[i]);
+            }
+        }
+        total += USLOSS_Clock() - start;
+
+        for (i = 0; i < victims; i++) {
+            join(&status);
+        }
+    }
+
+    USLOSS_Console("bench=zapmany method=%s victims=%d trials=%d "
+                   "zap_us=%.3f\n", batch ? "batch" : "loop", victims,
+                   TRIALS, (double) total / TRIALS / victims);
+} /* run */
+
+
+int start1(char *arg)
+{
+    int victims;
+
+    setProcLimit(MAXVICTIMS + 2);
+
+    for (victims = 10; victims <= MAXVICTIMS; victims *= 10) {
+        run(victims, 0);
+        run(victims, 1);
+    }
+
+    return 0;
+} /* start1 */
@@ -5,7 +5,39 @@ typedef struct procStruct procStruct;
 
 typedef struct procStruct * procPtr;
 
+typedef struct procCold procCold;
+
+/* Size of a cache line, procStructs are aligned to it */
+#define CACHELINE 64
+
+/* Parts of a process only touched when it is created or switched to */
+struct procCold {
+   char            name[MAXNAME];     /* process's name */
+   char            startArg[MAXARG];  /* args passed to process */
+   USLOSS_Context  state;             /* current context for process */
+   int (* startFunc) (char *);   /* function where process begins -- launch */
+   char           *stack;
+   unsigned int    stackSize;
+   int             stackClass;    /* stack pool size class, -1 if none */
+};
+
 struct procStruct {
+  /* Scheduling fields, the dispatcher and ReadyList walks only touch this
+     first cache line */
+   int             status;        /* READY, BLOCKED, QUIT, etc. */
+   int             priority;
+   int             pid;               /* process id */
+   unsigned int    onLists;           /* LISTFLAG bits of lists we are on */
+   procPtr         nextProcPtr;       /* for readylist */
+   procPtr         prevProcPtr;
+   int             heapIndex;     /* place in the fair heap, -1 if not in it */
+   int             zapped;
+   long long       vruntime;      /* SCHED_FAIR weighted CPU time */
+   int             time_slice_start;
+   int             charge_start;  /* when total_time_used was last charged */
+   int             total_time_used;
+   int             own_priority;      /* priority before any inherited boost */
+
   /* Head Pointer */
    procPtr         parentProcPtr;     
    procPtr         childProcPtr;
@@ -13,27 +45,52 @@ struct procStruct {
    procPtr         zappedProcPtr;
    procPtr         zappersProcPtr;
 
+   /* Tail Pointer */
+   procPtr         childTailPtr;
+   procPtr         quitChildTailPtr;
+   procPtr         zappersTailPtr;
+
    /* Next in List Pointer */
-   procPtr         nextProcPtr;       /* for readylist */
    procPtr         nextSiblingPtr;
    procPtr         nextQuitSibling;
    procPtr         nextZapperSibling;
+   procPtr         nextSleeper;       /* for a timer wheel slot */
+   procPtr         nextSemWaiter;     /* for a semaphore's wait queue */
 
-   char            name[MAXNAME];     /* process's name */
-   char            startArg[MAXARG];  /* args passed to process */
-   USLOSS_Context  state;             /* current context for process */
-   short           pid;               /* process id */
-   int             priority;
-   int (* startFunc) (char *);   /* function where process begins -- launch */
-   char           *stack;
-   unsigned int    stackSize;
-   int             status;        /* READY, BLOCKED, QUIT, etc. */
+   /* Previous in List Pointer */
+   procPtr         prevSiblingPtr;
+   procPtr         prevQuitSibling;
+   procPtr         prevZapperSibling;
+   procPtr         prevSleeper;
+   procPtr         prevSemWaiter;
+
+   procCold       *cold;          /* name, args, context and stack */
+   int             base_priority;     /* priority given to fork1 */
    int             exit_status;
-   int             zapped;
    int             num_children;
-   int             total_time_used;
-   int             time_slice_start;
+   procPtr         joinTarget;    /* child joinPid() waits on, NULL for any */
+   unsigned int    wakeTick;      /* timerNow tick sleepTicks() ends on */
+   int             timerLevel;    /* timer wheel level and slot we are in */
+   int             timerSlot;
+   int             semWaiting;    /* semaphore or mutex waited on, -1 if none */
+   int            *zapPids;       /* zapMany() pids still to wait for */
+   int             zapCount;      /* how many of them are left */
+   procPtr         waitNext;      /* who a wait-for search reached us from */
+   unsigned int    waitMark;      /* waitSearch this process was last seen in */
    /* other fields as needed... */
+} __attribute__((aligned(CACHELINE)));
+
+typedef struct semStruct semStruct;
+
+/* A semaphore, or a mutex when isMutex is set.  Waiters queue FIFO and
+   are handed the semaphore, or the mutex, directly when it is released. */
+struct semStruct {
+   int             inUse;
+   int             isMutex;
+   int             value;         /* semaphore count */
+   int             ownerPid;      /* pid holding the mutex, -1 if free */
+   procPtr         waitHead;
+   procPtr         waitTail;
 };
 
 struct psrBits {
@@ -58,13 +115,82 @@ union psrValues {
 #define BLOCKED  4
 #define JOIN_BLOCKED  5
 #define ZAP_BLOCKED  6
+#define SLEEP_BLOCKED  7
+#define SEM_BLOCKED  8
+#define MUTEX_BLOCKED  9
 
 #define BlOCKMEBLOCKED 11
 
+/* Set to 1 (or build with -DMMAPSTACKS=1) to mmap process stacks with a
+   guard page below each one instead of malloc'ing them */
+#ifndef MMAPSTACKS
+#define MMAPSTACKS 0
+#endif
+
+/* Default time slice quantum in microseconds */
+#define TIMESLICE 80000
+
+/* Set to 0 (or build with -DSCHEDTRACE=0) to compile the scheduler trace
+   ring out of the kernel, TRACESIZE is how many events it keeps */
+#ifndef SCHEDTRACE
+#define SCHEDTRACE 1
+#endif
+#define TRACESIZE 1024
+
+/* Scheduling policy the kernel starts with, and how often in microseconds
+   SCHED_MLFQ boosts every process back to its fork1 priority */
+#ifndef SCHEDPOLICY
+#define SCHEDPOLICY SCHED_FIXED
+#endif
+#define MLFQBOOST 1000000
+
+/* Set to 1 (or build with -DPRIOINHERIT=1) to start with priority
+   inheritance on, see setPriorityInheritance() */
+#ifndef PRIOINHERIT
+#define PRIOINHERIT 0
+#endif
+
+/* Set to 1 (or build with -DTICKLESS=1) to start with clock ticks skipped
+   while nothing needs them, see setTickless() */
+#ifndef TICKLESS
+#define TICKLESS 0
+#endif
+
+/* Timer wheel for sleepTicks(): WHEELLEVELS levels of WHEELSLOTS slots,
+   each level's slots covering WHEELSLOTS times the ticks of the one below */
+#define WHEELBITS 6
+#define WHEELSLOTS (1 << WHEELBITS)
+#define WHEELLEVELS 4
+
+/* Microseconds between USLOSS clock interrupts */
+#define TICKUS (USLOSS_CLOCK_MS * 1000)
+
+/* SCHED_FAIR weight of priority 3, each step up in priority is worth 1.5
+   times the CPU share of the one below */
+#define FAIRWEIGHT 1024
+
+/* Stack pool: size classes USLOSS_MIN_STACK << 0 .. STACKCLASSES - 1, and
+   the default number of free stacks kept per class */
+#define STACKCLASSES 4
+#define STACKPOOLCAP 16
+
+/* Starting size of the pid -> process hash, a power of two */
+#define PIDMAPSIZE 128
+
+/* Bytes dumpProcessesFiltered() gathers before each write, and the most
+   one of its lines can take */
+#define DUMPBUFSIZE 8192
+#define DUMPLINE 512
+
+/* Number of entries the process table grows by */
+#define PROCCHUNK 64
+
+/* Bit in procStruct.onLists for each list_to_change */
+#define LISTFLAG(which_list) (1u << (which_list))
+
 #define NO_CURRENT_PROCESS NULL
 #define MINPRIORITY 5
 #define MAXPRIORITY 1
 #define SENTINELPID 1
 #define SENTINELPRIORITY (MINPRIORITY + 1)
-#define AMOUNTPRIORITIES 7
 
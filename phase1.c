@@ -11,17 +11,81 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <strings.h>
 
 #include "kernel.h"
 
+#if MMAPSTACKS
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 /* ------------------------- Prototypes ----------------------------------- */
 int sentinel (char *);
 extern int start1 (char *);
 void dispatcher(void);
 void launch();
 static void checkDeadlock();
-int delete_node(procPtr *head, procPtr to_delete, list_to_change which_list);
-int add_node(procPtr *head, procPtr to_add, list_to_change which_list);
+int delete_node(procPtr *head, procPtr *tail, procPtr to_delete,
+                list_to_change which_list);
+int add_node(procPtr *head, procPtr *tail, procPtr to_add,
+             list_to_change which_list);
+static procPtr *next_link(procPtr node, list_to_change which_list);
+static procPtr *prev_link(procPtr node, list_to_change which_list);
+static void get_stack(procPtr proc, int stacksize);
+static void release_stack(procPtr proc);
+static char *alloc_stack(unsigned int size);
+static void free_stack(char *stack, unsigned int size);
+static int grow_proctable(void);
+static procPtr proc_slot(int slot);
+static void pidmap_insert(procPtr proc);
+static void pidmap_grow(void);
+static int pid_hash(int pid);
+static int cpu_time(procPtr proc);
+static void set_priority(procPtr proc, int priority);
+static void mlfq_boost(void);
+static void refresh_priority(procPtr proc);
+static void charge_cpu(procPtr proc, int now);
+static void fair_insert(procPtr proc);
+static void fair_remove(procPtr proc);
+static void fair_sift_up(int i);
+static void fair_sift_down(int i);
+#if SCHEDTRACE
+static void trace_event(int type, int pid, int other, int priority);
+#define TRACE(type, pid, other, priority) trace_event(type, pid, other, priority)
+#else
+#define TRACE(type, pid, other, priority)
+#endif
+static void pidmap_remove(int pid);
+procPtr find_process(int pid);
+static void add_to_readylist(procPtr to_add);
+static void remove_from_readylist(procPtr to_remove);
+static void check_wait_cycle(procPtr waiter);
+static void set_status(procPtr proc, int status);
+static int status_class(int status);
+static int tick_needed(void);
+static void join_block(procPtr target);
+static int reap_child(procPtr child, int *status);
+static int zap_next(procPtr zapper);
+static void timer_insert(procPtr proc);
+static void timer_cancel(procPtr proc);
+static int timer_tick(void);
+static void timer_cascade(int level);
+static void block_current(int status);
+static semStruct *sem_lookup(int id, int is_mutex);
+static int sem_create(int value, int is_mutex);
+static int sem_free(int id, int is_mutex);
+static void sem_wait(semStruct *sem, int id, int status);
+static void sem_handoff(semStruct *sem);
+static int should_preempt(void);
+static int maybe_dispatch(void);
+static void wait_report(procPtr waiter);
+static void wait_push(procPtr proc, procPtr from, int *count);
+static procPtr wait_first(procPtr proc);
+static procPtr wait_next(procPtr proc, procPtr edge);
+static int dump_line(char *line, procPtr proc, int format);
+static int dump_name(char *out, char *name, int format);
+static int in_subtree(procPtr proc, procPtr root);
 
 
 /* -------------------------- Globals ------------------------------------- */
@@ -29,11 +93,83 @@ int add_node(procPtr *head, procPtr to_add, list_to_change which_list);
 // Patrick's debugging global variable...
 int debugflag = 0;
 
-// the process table
-procStruct ProcTable[MAXPROC] = {};
+// the process table, PROCCHUNK entries per chunk so procPtrs never move
+static procStruct **ProcChunks = NULL;
+static int procChunkCount = 0;
+static int procSlots = 0;       // entries in all chunks
+static int procCount = 0;       // entries not UNUSED
+static int procLimit = MAXPROC; // most entries fork1 may have in use
 
 // Process lists
 static procPtr ReadyList[AMOUNTPRIORITIES];
+static procPtr ReadyTail[AMOUNTPRIORITIES];
+
+// microseconds a process may run before timeSlice() preempts it, 0 for never
+static int timeSliceQuantum = TIMESLICE;
+
+// how the dispatcher orders processes, see setSchedPolicy()
+static int schedPolicy = SCHEDPOLICY;
+
+// USLOSS_Clock() time of the last MLFQ priority boost
+static int lastBoost = 0;
+
+// whether waiters in zap and join lend their priority, see refresh_priority()
+static int priorityInheritance = PRIOINHERIT;
+
+// processes in each status except UNUSED, sleepers and blockMe statuses
+// count as BLOCKED
+static int statusCount[ZAP_BLOCKED + 1];
+
+// stamps the processes visited by each wait-for graph search
+static unsigned int waitSearch = 0;
+
+// processes a wait-for graph search has reached, in the order it did
+static procPtr *WaitNodes = NULL;
+static int waitNodesCapacity = 0;
+
+// whether clock ticks nobody needs are skipped, see setTickless()
+static int tickless = TICKLESS;
+
+// clock interrupts taken, and how many of them tickless mode skipped
+static int clockInterrupts = 0;
+static int clockTicksSkipped = 0;
+
+// sleepTicks() sleepers, by wake tick, and the clock interrupts so far
+static procPtr TimerWheel[WHEELLEVELS][WHEELSLOTS];
+static procPtr TimerTail[WHEELLEVELS][WHEELSLOTS];
+static unsigned int timerNow = 0;
+static int sleepCount = 0;
+
+// semaphores and mutexes, and a stack of the unused entries
+static semStruct SemTable[MAXSEMS];
+static int freeSems[MAXSEMS];
+static int freeSemCount = 0;
+
+// calls to maybe_dispatch() that skipped or ran the dispatcher
+static int dispatchesElided = 0;
+static int dispatchesPerformed = 0;
+
+// counters getKernelStats() reports
+static kernelStats kernelCounts;
+
+// SCHED_FAIR run queue, a binary min-heap of ready processes on vruntime
+static procPtr *FairHeap = NULL;
+static int fairCount = 0;
+static int fairCapacity = 0;
+static long long fairMinVruntime = 0;
+
+// SCHED_FAIR share of each priority, FAIRWEIGHT is priority 3's share
+static const int fairWeight[AMOUNTPRIORITIES] = {0, 2304, 1536, FAIRWEIGHT,
+                                                 683, 455, 0};
+
+#if SCHEDTRACE
+// the last TRACESIZE scheduler events, traceNext counts every event recorded
+static traceEvent TraceRing[TRACESIZE];
+static unsigned int traceNext = 0;
+#endif
+
+// bit i is set iff ReadyList[i] is non-empty
+static unsigned int readyBitmap = 0;
 
 // current process
 procPtr Current;
@@ -41,6 +177,24 @@ procPtr Current;
 // the next pid to be assigned
 unsigned int nextPid = SENTINELPID;
 
+// stack of unused process table entries
+static procPtr *freeSlots = NULL;
+static int freeSlotCount = 0;
+
+// open addressed pid -> process table, linear probing from pid_hash(pid)
+static procPtr *PidMap = NULL;
+static int pidMapMask = -1;
+
+// free stacks of size USLOSS_MIN_STACK << i, linked through their first word
+static char *stackPool[STACKCLASSES];
+static int stackPoolCount[STACKCLASSES];
+static int stackPoolCap = STACKPOOLCAP;
+static int stackPoolHits = 0;
+static int stackPoolMisses = 0;
+
+// lines dumpProcessesFiltered() has yet to write out
+static char dumpBuf[DUMPBUFSIZE];
+
 
 /* -------------------------- Functions ----------------------------------- */
 /* ------------------------------------------------------------------------
@@ -56,14 +210,24 @@ void startup()
     int result; // value returned by call to fork1()
     Current = NULL;
 
-    // initialize the process table
+    // initialize the process table, it grows from here as fork1 needs it
     if (DEBUG && debugflag)
         USLOSS_Console("startup(): initializing process table, ProcTable[]\n");
 
+    if (grow_proctable() == -1) {
+        USLOSS_Console("startup(): could not allocate process table.  Halting...\n");
+        USLOSS_Halt(1);
+    }
+
     // Initialize the Ready list, etc.
     if (DEBUG && debugflag)
         USLOSS_Console("startup(): initializing the Ready list\n");
 
+    // every semaphore starts out free, lowest ids handed out first
+    for (result = MAXSEMS - 1; result >= 0; result--) {
+        freeSems[freeSemCount++] = result;
+    }
+
     // Initialize the clock interrupt handler
     USLOSS_IntVec[USLOSS_CLOCK_INT] = clock_interrupt_handler;
 
@@ -117,8 +281,10 @@ void startup()
    ----------------------------------------------------------------------- */
 void finish()
 {
-    if (DEBUG && debugflag)
+    if (DEBUG && debugflag) {
         USLOSS_Console("in finish...\n");
+        dumpTrace();
+    }
 } /* finish */
 
 
@@ -137,7 +303,8 @@ void finish()
 int fork1(char *name, int (*startFunc)(char *), char *arg,
           int stacksize, int priority)
 {
-    int i, newpid, procSlot = -1;
+    int newpid;
+    int flags;
     procPtr new_process = NULL;
 
 
@@ -156,38 +323,39 @@ int fork1(char *name, int (*startFunc)(char *), char *arg,
 
     // Return if stack size is too small
     if (stacksize < USLOSS_MIN_STACK) {
+        kernelCounts.failedForks++;
         return -2;
     }
 
 
     // check if name, startFunc and priorities are valid
     if (name == NULL || startFunc == NULL || priority < 1 || priority > 6) {
+        kernelCounts.failedForks++;
         return -1;
     }
 
-    // find an empty slot in the process table, and change PID
-    for (i = 0; i < MAXPROC; i++) {
-        
-        if (ProcTable[nextPid % MAXPROC].status == UNUSED) {
-            procSlot = nextPid % MAXPROC;
-            break;
-        }
-        nextPid++;
+    // check if table is full, growing it if we are under the limit, then
+    // take a free slot and the next pid
+    flags = irqSave();
+    if (procCount >= procLimit) {
+        kernelCounts.failedForks++;
+        irqRestore(flags);
+        return -1;
     }
 
-    newpid = nextPid;
-    nextPid++;
-
-
-    // check if table is full and set pid, then disable interupts
-    if (procSlot == -1) {
+    if (freeSlotCount == 0 && grow_proctable() == -1) {
+        kernelCounts.failedForks++;
+        irqRestore(flags);
         return -1;
     }
 
-    new_process = &ProcTable[procSlot];
-    new_process->pid = newpid;
+    new_process = freeSlots[--freeSlotCount];
+    procCount++;
+    newpid = nextPid;
+    nextPid++;
 
-    disableInterrupts();
+    new_process->pid = newpid;
+    pidmap_insert(new_process);
 
 
     // fill-in entry in process table */
@@ -198,84 +366,98 @@ int fork1(char *name, int (*startFunc)(char *), char *arg,
     
 
     // copy in name of process into process, and argument
-    strcpy(new_process->name, name);
-    new_process->startFunc = startFunc;
+    strcpy(new_process->cold->name, name);
+    new_process->cold->startFunc = startFunc;
     
     if (arg == NULL) {
-        new_process->startArg[0] = '\0';
+        new_process->cold->startArg[0] = '\0';
     }
     else if (strlen(arg) >= (MAXARG - 1)) {
         USLOSS_Console("fork1(): argument too long.  Halting...\n");
         USLOSS_Halt(1);
     }
     else {
-        strcpy(new_process->startArg, arg);
+        strcpy(new_process->cold->startArg, arg);
     }
 
     
-    // create new stack space
-    char *new_stack = malloc(sizeof(char) * stacksize);
-    if (new_stack == NULL) {
-        USLOSS_Console("fork1(): Error when allocating stack space.\n");
-        USLOSS_Halt(1);
-    }
-    
-    new_process->stack = new_stack;
+    // get stack space, from the pool if one of the right size is free
+    get_stack(new_process, stacksize);
 
 
     // save the start function, arg, priority,
-    new_process->startFunc = startFunc;
+    new_process->cold->startFunc = startFunc;
     new_process->priority = priority;
-    new_process->stackSize = stacksize;
-    new_process->status = READY;
+    new_process->base_priority = priority;
+    new_process->own_priority = priority;
+    new_process->vruntime = 0;
+    new_process->heapIndex = -1;
+    new_process->joinTarget = NULL;
+    new_process->zapCount = 0;
+    new_process->semWaiting = -1;
+    new_process->waitNext = NULL;
+    new_process->waitMark = 0;
+    set_status(new_process, READY);
     new_process->exit_status = 0;
     new_process->zapped = 0;
     new_process->num_children = 0;
     new_process->total_time_used = 0;
     new_process->time_slice_start = 0;
+    new_process->charge_start = 0;
 
 
     // set up procPtr
     new_process->nextProcPtr = NULL;
+    new_process->prevProcPtr = NULL;
     new_process->childProcPtr = NULL;
+    new_process->childTailPtr = NULL;
     new_process->nextSiblingPtr = NULL;
+    new_process->prevSiblingPtr = NULL;
     new_process->quitChildProcPtr = NULL;
+    new_process->quitChildTailPtr = NULL;
     new_process->nextQuitSibling = NULL;
+    new_process->prevQuitSibling = NULL;
     new_process->zappedProcPtr = NULL;
     new_process->zappersProcPtr = NULL;
+    new_process->zappersTailPtr = NULL;
     new_process->nextZapperSibling = NULL;
+    new_process->prevZapperSibling = NULL;
+    new_process->onLists = 0;
     new_process->parentProcPtr = Current;
 
 
     // Initialize context for this process, but use launch function pointer for
     // the initial value of the process's program counter (PC)
-    USLOSS_ContextInit(&(new_process->state), USLOSS_PsrGet(),
-                       new_process->stack,
-                       new_process->stackSize,
+    USLOSS_ContextInit(&(new_process->cold->state), USLOSS_PsrGet(),
+                       new_process->cold->stack,
+                       new_process->cold->stackSize,
                        launch);
 
 
     // add child to parent children list
     if (Current != NULL) {
-        add_node(&Current->childProcPtr, new_process, CHILDRENLIST);
+        Current->num_children++;
+        add_node(&Current->childProcPtr, &Current->childTailPtr,
+                 new_process, CHILDRENLIST);
     }
 
 
     // insert into ready list
-    procPtr *readylist = &ReadyList[priority];
-    add_node(readylist, new_process, READYLIST);
+    add_to_readylist(new_process);
+    kernelCounts.forks++;
     
     
     // for future phase(s)
     p1_fork(new_process->pid);
+    TRACE(TRACE_FORK, newpid, Current == NULL ? -1 : Current->pid, priority);
 
 
-    // call dispatcher to switch context if needed
+    // call dispatcher to switch context if the child outranks us
     if (startFunc != sentinel) {
-        dispatcher();
+        maybe_dispatch();
     } 
 
-
+    irqRestore(flags);
     return newpid;
 } /* fork1 */
 
@@ -302,7 +484,7 @@ void launch()
     
 
     // Call the function passed to fork1, and capture its return value
-    result = Current->startFunc(Current->startArg);
+    result = Current->cold->startFunc(Current->cold->startArg);
 
     if (DEBUG && debugflag) {
         USLOSS_Console("Process %d returned to launch\n", Current->pid);
@@ -327,47 +509,163 @@ void launch()
    ------------------------------------------------------------------------ */
 int join(int *status)
 {
-    // block off the parents
-    procPtr children, quit_children;
-    
-    children = Current->childProcPtr;
-    quit_children = Current->quitChildProcPtr;
-
+    int pid;
+    int flags;
 
     // check to see that you have no children
-    if (children == NULL && quit_children == NULL) {
+    if (Current->childProcPtr == NULL && Current->quitChildProcPtr == NULL) {
         return -2;
     }
 
 
-    // check your quit_children list to check if you have any quit
-    // child processes
-    if (quit_children != NULL) {
-        *status = quit_children->exit_status;
-        quit_children->status = UNUSED;
+    // no children have quit yet, you must join block the parent
+    flags = irqSave();
+    while (Current->quitChildProcPtr == NULL) {
+        join_block(NULL);
+    }
 
-        // delete of the parents quit list and also from the readylist
-        delete_node(&Current->quitChildProcPtr, quit_children, QUITLIST);
-        delete_node(&ReadyList[quit_children->priority], quit_children, READYLIST);
+    pid = reap_child(Current->quitChildProcPtr, status);
+    kernelCounts.joins++;
+    irqRestore(flags);
 
-        // check to see if you are already zapped
-        if (isZapped()) {
-            return -1;
-        }
+    // check to see if you are already zapped
+    if (isZapped()) {
+        return -1;
+    }
+
+    return pid;
+} /* join */
+
+
+/* ------------------------------------------------------------------------
+   Name - joinPid
+   Purpose - Wait for one particular child to quit.  The caller is only
+             woken when that child quits, not by its siblings.
+   Parameters - the pid of the child, and a pointer to an int where its
+                termination code is to be stored.
+   Returns - the pid joined on.
+             -1 if the process was zapped in the join
+             -2 if pid is not a child of the process
+   Side Effects - the parent may be blocked until the child quits.
+   ------------------------------------------------------------------------ */
+int joinPid(int pid, int *status)
+{
+    int flags = irqSave();
+    procPtr child = find_process(pid);
+
+    if (child == NULL || child->parentProcPtr != Current) {
+        irqRestore(flags);
+        return -2;
+    }
 
-        return quit_children->pid;
+    while (child->status != QUIT) {
+        join_block(child);
     }
-    else {
-        // no children have quit yet, you must join block the parent
-        Current->status = JOIN_BLOCKED;
+
+    reap_child(child, status);
+    kernelCounts.joins++;
+    irqRestore(flags);
+
+    if (isZapped()) {
+        return -1;
+    }
+
+    return pid;
+} /* joinPid */
+
+
+/* ------------------------------------------------------------------------
+   Name - joinAll
+   Purpose - Reaps every child that has quit, up to max of them, blocking
+             once if none has quit yet.
+   Parameters - an array of max ints where the termination codes are
+                stored, in the order the children quit, and its size.
+   Returns - the number of children joined on.
+             -1 if the process was zapped in the join
+             -2 if the process has no children
+   Side Effects - the parent may be blocked until a child quits.
+   ------------------------------------------------------------------------ */
+int joinAll(int *statuses, int max)
+{
+    int count = 0;
+    int flags;
+
+    if (Current->childProcPtr == NULL && Current->quitChildProcPtr == NULL) {
+        return -2;
+    }
+
+    flags = irqSave();
+    if (Current->quitChildProcPtr == NULL) {
+        join_block(NULL);
+    }
+
+    while (count < max && Current->quitChildProcPtr != NULL) {
+        reap_child(Current->quitChildProcPtr, &statuses[count]);
+        count++;
+    }
+    kernelCounts.joins += count;
+    irqRestore(flags);
+
+    if (isZapped()) {
+        return -1;
+    }
+
+    return count;
+} /* joinAll */
+
+
+/* ------------------------------------------------------------------------
+   Name - join_block
+   Purpose - blocks the current process in join until a child quits
+   Parameters - the child to wait for, NULL for any child
+   Returns - nothing
+   Side Effects - the dispatcher runs other processes meanwhile
+   ------------------------------------------------------------------------ */
+static void join_block(procPtr target) {
+    Current->joinTarget = target;
+    block_current(JOIN_BLOCKED);
+
+    // whichever child can wake us borrows our priority
+    if (priorityInheritance) {
+        procPtr child;
+
+        for (child = Current->childProcPtr; child != NULL; child = child->nextSiblingPtr) {
+            refresh_priority(child);
+        }
     }
 
+    // halt now if every child that can wake us is, in the end, waiting on us
+    check_wait_cycle(Current);
 
-    // call dispatcher, then check if process got zapped
     dispatcher();
+    Current->joinTarget = NULL;
+} /* join_block */
 
-    return join(status);
-} /* join */
+
+/* ------------------------------------------------------------------------
+   Name - reap_child
+   Purpose - frees a quit child of the current process
+   Parameters - the child, and where to store its termination code
+   Returns - the child's pid
+   Side Effects - the child's slot and stack go back to be reused
+   ------------------------------------------------------------------------ */
+static int reap_child(procPtr child, int *status) {
+    *status = child->exit_status;
+    set_status(child, UNUSED);
+    Current->num_children--;
+    release_stack(child);
+
+    // the slot can be reused, the pid never is
+    pidmap_remove(child->pid);
+    freeSlots[freeSlotCount++] = child;
+    procCount--;
+
+    // delete of the parents quit list, quit already took it off the readylist
+    delete_node(&Current->quitChildProcPtr, &Current->quitChildTailPtr,
+                child, QUITLIST);
+
+    return child->pid;
+} /* reap_child */
 
 
 /* ------------------------------------------------------------------------
@@ -397,41 +695,72 @@ void quit(int status)
         USLOSS_Halt(1);
     }
 
-    disableInterrupts();
+    // never restored, the dispatcher does not come back to a quit process
+    irqSave();
+
+    // quit children nobody joined can never be joined now, free them so
+    // none is left with a parentProcPtr to our slot once it is reused
+    while (Current->quitChildProcPtr != NULL) {
+        int unjoined_status;
+
+        reap_child(Current->quitChildProcPtr, &unjoined_status);
+    }
     
     // store the exit status into the exit_status struct member
     Current->exit_status = status;
 
     
-    // change the status to quit
-    Current->status = QUIT;
+    // change the status to quit and take it off the ReadyList
+    set_status(Current, QUIT);
+    remove_from_readylist(Current);
+    kernelCounts.quits++;
 
 
     // delete from parents children list and add to parents quit children list
     if (parent != NULL) {
         // here is the error
-        delete_node(&parent->childProcPtr, toQuit, CHILDRENLIST);
-        add_node(&parent->quitChildProcPtr, toQuit, QUITLIST);
+        delete_node(&parent->childProcPtr, &parent->childTailPtr,
+                    toQuit, CHILDRENLIST);
+        add_node(&parent->quitChildProcPtr, &parent->quitChildTailPtr,
+                 toQuit, QUITLIST);
    	    
-        // if parent is blocked child must unblock it
-   	    if (parent->status == JOIN_BLOCKED) {
+        // if parent is blocked child must unblock it, and its priority is
+        // no longer lent to our siblings
+   	    if (parent->status == JOIN_BLOCKED &&
+            (parent->joinTarget == NULL || parent->joinTarget == toQuit)) {
             unblockRegularProc(parent->pid);
+
+            if (priorityInheritance) {
+                procPtr sibling;
+
+                for (sibling = parent->childProcPtr; sibling != NULL;
+                     sibling = sibling->nextSiblingPtr) {
+                    refresh_priority(sibling);
+                }
+            }
         }
     }
 
 
-    // unblock all zappers
-    if (Current->zappersProcPtr != NULL) {
-        procPtr scout = Current->zappersProcPtr; 
-        
-        while (scout != NULL) {
+    // unblock all zappers, taking each off the zapper list so it can zap again
+    while (Current->zappersProcPtr != NULL) {
+        procPtr scout = Current->zappersProcPtr;
+
+        delete_node(&Current->zappersProcPtr, &Current->zappersTailPtr,
+                    scout, ZAPPERLIST);
+
+        // a zapMany() caller moves on to its next victim, if any are left
+        if (zap_next(scout)) {
+            check_wait_cycle(scout);
+        }
+        else {
             unblockRegularProc(scout->pid);
-            scout = scout->nextZapperSibling;
         }
     }
     
 
     p1_quit(Current->pid);
+    TRACE(TRACE_QUIT, Current->pid, status, Current->priority);
     dispatcher();
 } /* quit */
 
@@ -449,26 +778,41 @@ void quit(int status)
 void dispatcher(void)
 {
     procPtr next_process = NULL;
-    int i;
+    int now = USLOSS_Clock();
 
 
-    // loop through ready list in order of greatest priority
-    for (i = MAXPRIORITY; i < AMOUNTPRIORITIES; i++) {
+    // charge the old process for its run, which also settles its vruntime
+    if (Current != NULL) {
+        charge_cpu(Current, now);
+    }
 
-        if (ReadyList[i] != NULL) {
-            next_process = ReadyList[i];
-            
-            // if process is anything but ready, it is removed
-            while (next_process != NULL && next_process->status != READY) {
-                delete_node(&ReadyList[i], next_process, READYLIST);
-                next_process = ReadyList[i];
-            }
 
-            if (next_process != NULL) {
-                break;
-            }
+    // SCHED_FAIR runs the least vruntime, the sentinel only if none are ready
+    if (fairCount > 0) {
+        next_process = FairHeap[0];
+        if (next_process->vruntime > fairMinVruntime) {
+            fairMinVruntime = next_process->vruntime;
         }
     }
+    else if (readyBitmap == 0) {
+        USLOSS_Console("dispatcher(): no process is ready to run.  Halting...\n");
+        USLOSS_Halt(1);
+    }
+    else {
+        // the lowest set bit is the highest priority non-empty ReadyList
+        next_process = ReadyList[ffs(readyBitmap) - 1];
+        kernelCounts.readyPicks++;
+        kernelCounts.readyInspected++;
+    }
+
+
+    // blocked and quit processes leave the ReadyList when their status
+    // changes, so the head should always be READY
+    if (next_process->status != READY) {
+        USLOSS_Console("dispatcher(): process %d on ReadyList is not ready.  Halting...\n",
+                       next_process->pid);
+        USLOSS_Halt(1);
+    }
 
 
     // set the pointers to the new processes
@@ -476,22 +820,34 @@ void dispatcher(void)
     Current = next_process;
 
 
-    // add the process to the end of the readylist
-    delete_node(&ReadyList[Current->priority], Current, READYLIST);
-    add_node(&ReadyList[Current->priority], Current, READYLIST);
-    Current->nextProcPtr = NULL;
+    // add the process to the end of the readylist, the fair heap keeps it
+    // where its vruntime puts it
+    if (Current->heapIndex == -1) {
+        remove_from_readylist(Current);
+        add_to_readylist(Current);
+    }
+
+
+    // a process switched in starts a new time slice
+    if (Current != old_process) {
+        Current->time_slice_start = now;
+        Current->charge_start = now;
+        kernelCounts.switches++;
+        TRACE(TRACE_SWITCH, old_process == NULL ? -1 : old_process->pid,
+              Current->pid, Current->priority);
+    }
 
     
     // dont save the state of the process at the very beginning if sentinel, or
-    // if the old process' state is QUIT, enable interrupts
+    // if the old process' state is QUIT.  Interrupts are left as the caller
+    // has them, the new process restores its own with irqRestore(), or
+    // launch() enables them for a new one
     if (old_process == NULL || old_process->status == QUIT) {
-        enableInterrupts();
-        USLOSS_ContextSwitch(NULL, &Current->state);
+        USLOSS_ContextSwitch(NULL, &Current->cold->state);
     }
     else {
-        enableInterrupts();
         p1_switch(old_process->pid, Current->pid);
-        USLOSS_ContextSwitch(&old_process->state, &Current->state);
+        USLOSS_ContextSwitch(&old_process->cold->state, &Current->cold->state);
     }
 
 } /* dispatcher */
@@ -526,15 +882,31 @@ int sentinel (char *dummy)
 static void checkDeadlock()
 {
     int i;
+    int num_proc;
+
+    // sleepers will be woken by the clock, wait for them
+    if (sleepCount > 0) {
+        return;
+    }
 
-    // check through all of the ReadyList
-    for (i = 0; i < MAXPROC; i++) {
+    // zap and join cycles halt as they form, anything still waiting now
+    // (in join, or in blockMe with nobody left to unblock it) never will
+    num_proc = statusCount[READY] + statusCount[BLOCKED] +
+               statusCount[JOIN_BLOCKED] + statusCount[ZAP_BLOCKED];
 
-        // make sure all processes are done
-        if (ProcTable[i].priority != SENTINELPRIORITY && ProcTable[i].status == ZAP_BLOCKED) {
-            USLOSS_Console("checkDeadlock(): numProc = %d. Only Sentinel should be left. Halting...\n", ProcTable[i].pid);
-            USLOSS_Halt(1);
+    if (num_proc > 1) {
+        USLOSS_Console("checkDeadlock(): numProc = %d. Only Sentinel should be left. Halting...\n", num_proc);
+
+        for (i = 0; i < procSlots; i++) {
+            procPtr proc = proc_slot(i);
+
+            if (proc->status != UNUSED && proc->status != QUIT &&
+                proc->pid != SENTINELPID) {
+                USLOSS_Console("checkDeadlock(): pid %d is blocked, status %d\n",
+                               proc->pid, proc->status);
+            }
         }
+        USLOSS_Halt(1);
     }
 
     USLOSS_Console("All processes completed.\n");
@@ -547,17 +919,7 @@ static void checkDeadlock()
  */
 void disableInterrupts()
 {
-    // turn the interrupts OFF iff we are in kernel mode
-    if((USLOSS_PSR_CURRENT_MODE & USLOSS_PsrGet()) == 0) {
-        //not in kernel mode
-        USLOSS_Console("Kernel Error: Not in kernel mode, may not ");
-        USLOSS_Console("disable interrupts\n");
-        USLOSS_Halt(1);
-    }
-    else {
-        // We ARE in kernel mode
-        USLOSS_PsrSet( USLOSS_PsrGet() & ~USLOSS_PSR_CURRENT_INT);
-    }
+    irqSave();
 } /* disableInterrupts */
 
 
@@ -566,205 +928,787 @@ void disableInterrupts()
  */
 void enableInterrupts()
 {
-    // turn the interrupts OFF iff we are in kernel mode
-    if ((USLOSS_PSR_CURRENT_MODE & USLOSS_PsrGet()) == 0) {
+    unsigned int psr = USLOSS_PsrGet();
+
+    // turn the interrupts ON iff we are in kernel mode
+    if ((psr & USLOSS_PSR_CURRENT_MODE) == 0) {
         //not in kernel mode
         USLOSS_Console("Kernel Error: Not in kernel mode, may not ");
         USLOSS_Console("enable interrupts\n");
         USLOSS_Halt(1);
     }
-    else {
-        // We ARE in kernel mode
-        USLOSS_PsrSet(USLOSS_PsrGet() | USLOSS_PSR_CURRENT_INT);
-    }
-} /* enableInterrupts */
-
 
+    USLOSS_PsrSet(psr | USLOSS_PSR_CURRENT_INT);
+} /* enableInterrupts */
 
-/* ------------------------------------------------------------------------
-   Name - delete node
-   Purpose - deletes a node from a list (either the readylist or sibling list)
-   Parameters - the head of the list and the address of the node to be removed
-   Returns - and int indicating whether the node was successfully remove
-   Side Effects - removes the specified node from the list
-   ------------------------------------------------------------------------ */
-int delete_node(procPtr *head, procPtr to_delete, list_to_change which_list) {
-    procPtr scout;
 
-    scout = *head;
+/*
+ * Disables the interrupts, returning whether they were on so that
+ * irqRestore() can put them back.  Pairs nest: an inner irqRestore() leaves
+ * interrupts off if they were off when the outer irqSave() was called.
+ */
+int irqSave()
+{
+    unsigned int psr = USLOSS_PsrGet();
 
-    if (scout == NULL) {
-        return 0;
+    // turn the interrupts OFF iff we are in kernel mode
+    if ((psr & USLOSS_PSR_CURRENT_MODE) == 0) {
+        //not in kernel mode
+        USLOSS_Console("Kernel Error: Not in kernel mode, may not ");
+        USLOSS_Console("disable interrupts\n");
+        USLOSS_Halt(1);
     }
 
-    switch (which_list) {
-        case READYLIST:
-            if (scout == to_delete) {
-                *head = scout->nextProcPtr;
-                return 1;
-            }
-
-            while (scout->nextProcPtr != NULL) {
-                if (scout->nextProcPtr == to_delete) {
-                    scout->nextProcPtr = scout->nextProcPtr->nextProcPtr;
-                    return 1;
-                }
+    USLOSS_PsrSet(psr & ~USLOSS_PSR_CURRENT_INT);
 
-                scout = scout->nextProcPtr;
-            }
+    return psr & USLOSS_PSR_CURRENT_INT;
+} /* irqSave */
 
-            return 0;
 
-        case QUITLIST:
-            if (scout == to_delete) {
-                *head = scout->nextQuitSibling;
-                return 1;
-            }
+/*
+ * Turns the interrupts back on if they were on at the matching irqSave().
+ */
+void irqRestore(int flags)
+{
+    if (flags & USLOSS_PSR_CURRENT_INT) {
+        USLOSS_PsrSet(USLOSS_PsrGet() | USLOSS_PSR_CURRENT_INT);
+    }
+} /* irqRestore */
 
-            while (scout->nextQuitSibling != NULL) {
-                if (scout->nextQuitSibling == to_delete) {
-                    scout->nextQuitSibling = scout->nextQuitSibling->nextQuitSibling;
-                    return 1;
-                }
 
-                scout = scout->nextQuitSibling;
-            }
 
-            return 0;
+/* ------------------------------------------------------------------------
+   Name - grow_proctable
+   Purpose - adds a chunk of PROCCHUNK unused entries to the process table
+             and pushes them on the free slot stack.  Entries are never
+             moved, so procPtrs stay valid while the table grows.
+   Parameters - none
+   Returns - 0 if the table grew, -1 if it is at procLimit or out of memory
+   Side Effects - ProcChunks and freeSlots are changed
+   ------------------------------------------------------------------------ */
+static int grow_proctable(void) {
+    procStruct *chunk = NULL;
+    procCold *cold;
+    procStruct **chunks;
+    procPtr *free_slots;
+    int i;
 
-        case CHILDRENLIST:
-            if (scout == to_delete) {
-                *head = scout->nextSiblingPtr;
-                return 1;
-            }
-	
-             while (scout->nextSiblingPtr != NULL) {
-                if (scout->nextSiblingPtr == to_delete) {
-                    scout->nextSiblingPtr = scout->nextSiblingPtr->nextSiblingPtr;
-                    return 1;
-                }
+    if (procSlots >= procLimit) {
+        return -1;
+    }
 
-                scout = scout->nextSiblingPtr;
-            }
+    // the hot entries are packed cache line aligned, the cold parts apart
+    if (posix_memalign((void **) &chunk, CACHELINE,
+                       PROCCHUNK * sizeof(procStruct)) != 0) {
+        chunk = NULL;
+    }
+    cold = calloc(PROCCHUNK, sizeof(procCold));
+    chunks = realloc(ProcChunks, (procChunkCount + 1) * sizeof(procStruct *));
+    if (chunks != NULL) {
+        ProcChunks = chunks;
+    }
 
-            return 0;
+    free_slots = realloc(freeSlots, (procSlots + PROCCHUNK) * sizeof(procPtr));
+    if (free_slots != NULL) {
+        freeSlots = free_slots;
+    }
 
-        case ZAPPERLIST:
-            if (scout == to_delete) { 
-                *head = scout->nextZapperSibling;
-                return 1;
-            }
-    
-             while (scout->nextZapperSibling != NULL) {
-                if (scout->nextZapperSibling == to_delete) {
-                    scout->nextZapperSibling = scout->nextZapperSibling->nextZapperSibling;
-                    return 1;
-                }
+    if (chunk == NULL || cold == NULL || chunks == NULL || free_slots == NULL) {
+        free(chunk);
+        free(cold);
+        return -1;
+    }
 
-                scout = scout->nextZapperSibling;
-            }
+    memset(chunk, 0, PROCCHUNK * sizeof(procStruct));
+    ProcChunks[procChunkCount++] = chunk;
+    procSlots += PROCCHUNK;
 
-            return 0;
+    // push in reverse so the lowest entry is handed out first
+    for (i = PROCCHUNK - 1; i >= 0; i--) {
+        chunk[i].cold = &cold[i];
+        freeSlots[freeSlotCount++] = &chunk[i];
     }
 
     return 0;
-} /* deletenode */
+} /* grow_proctable */
 
 
+/* ------------------------------------------------------------------------
+   Name - proc_slot
+   Purpose - finds a process table entry by its position in the table
+   Parameters - the position, from 0 up to procSlots
+   Returns - the entry
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+static procPtr proc_slot(int slot) {
+    return &ProcChunks[slot / PROCCHUNK][slot % PROCCHUNK];
+} /* proc_slot */
+
 
 /* ------------------------------------------------------------------------
-   Name - add node
-   Purpose -
-   Parameters -
-   Returns -
-   Side Effects -
+   Name - setProcLimit
+   Purpose - changes how many processes may exist at once.  The process
+             table grows as needed up to the limit.
+   Parameters - the new limit, at least the number of processes in use
+   Returns - the old limit, or -1 if the new limit is too small
+   Side Effects - none
    ------------------------------------------------------------------------ */
-int add_node(procPtr *head, procPtr to_add, list_to_change which_list) {
-    procPtr scout;
-    scout = *head;
+int setProcLimit(int limit) {
+    int old_limit = procLimit;
 
-    if (*head == NULL) {
-        *head = to_add;
-        return 1;
+    if (limit < procCount || limit < 1) {
+        return -1;
     }
 
-    switch (which_list) {
-        case READYLIST:
-             while (scout->nextProcPtr != NULL) {
-                
-                if (scout == to_add) {
-                    USLOSS_Console("THE HORSE HAS POUNCED ON YOU!");
-                    USLOSS_Halt(1);
-                }
-                scout = scout->nextProcPtr;
-            }
+    procLimit = limit;
 
-            scout->nextProcPtr = to_add;
-            return 1;
+    return old_limit;
+} /* setProcLimit */
 
-        case QUITLIST:
-            while (scout->nextQuitSibling != NULL) {
-                
-                if (scout == to_add) {
-                    USLOSS_Console("THE HORSE HAS POUNCED ON YOU!");
-                    USLOSS_Halt(1);
-                }
-                scout = scout->nextQuitSibling;
-            }
 
-            scout->nextQuitSibling = to_add;
-            return 1;
+/* ------------------------------------------------------------------------
+   Name - pid_hash
+   Purpose - finds the home entry of a pid in PidMap.  Pids are handed out
+             in order, so they are scattered with a multiplicative hash;
+             otherwise live pids form one long probe run and removing one
+             has to shift the whole run.
+   Parameters - the pid
+   Returns - an index into PidMap
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+static int pid_hash(int pid) {
+    return ((unsigned int) pid * 2654435761u) & pidMapMask;
+} /* pid_hash */
 
-        case CHILDRENLIST:
-            while (scout->nextSiblingPtr != NULL) {
-                
-                if (scout == to_add) {
-                    USLOSS_Console("THE HORSE HAS POUNCED ON YOU!");
-                    USLOSS_Halt(1);
-                }
-                scout = scout->nextSiblingPtr;
-            }
 
-            scout->nextSiblingPtr = to_add;
-            return 1;
+/* ------------------------------------------------------------------------
+   Name - pidmap_insert
+   Purpose - records a process under its pid in PidMap
+   Parameters - the process, its pid must already be set
+   Returns - nothing
+   Side Effects - PidMap is changed
+   ------------------------------------------------------------------------ */
+static void pidmap_insert(procPtr proc) {
+    int i;
 
-        case ZAPPERLIST:
-            while (scout->nextZapperSibling != NULL) {
-                
-                if (scout == to_add) {
-                    USLOSS_Console("THE HORSE HAS POUNCED ON YOU!");
-                    USLOSS_Halt(1);
-                }
-                scout = scout->nextZapperSibling;
-            }
+    // keep the map at most half full so probe runs stay short
+    if (2 * procCount > pidMapMask) {
+        pidmap_grow();
+    }
 
-            scout->nextZapperSibling = to_add;
-            return 1;
+    i = pid_hash(proc->pid);
+    while (PidMap[i] != NULL) {
+        i = (i + 1) & pidMapMask;
     }
 
-    return 0;
-} /* add_node */
+    PidMap[i] = proc;
+} /* pidmap_insert */
 
 
 /* ------------------------------------------------------------------------
-   Name -  clock_interrupt_handler
-   Purpose -
-   Parameters -
-   Returns -
-   Side Effects -
+   Name - pidmap_grow
+   Purpose - doubles the size of PidMap and rehashes every entry in it
+   Parameters - none
+   Returns - nothing
+   Side Effects - PidMap is replaced, halts if out of memory
+   ------------------------------------------------------------------------ */
+static void pidmap_grow(void) {
+    procPtr *old_map = PidMap;
+    int old_size = pidMapMask + 1;
+    int new_size = old_size == 0 ? PIDMAPSIZE : 2 * old_size;
+    int i, j;
+
+    PidMap = calloc(new_size, sizeof(procPtr));
+    if (PidMap == NULL) {
+        USLOSS_Console("pidmap_grow(): out of memory.  Halting...\n");
+        USLOSS_Halt(1);
+    }
+
+    pidMapMask = new_size - 1;
+
+    for (i = 0; i < old_size; i++) {
+        if (old_map[i] != NULL) {
+            j = pid_hash(old_map[i]->pid);
+            while (PidMap[j] != NULL) {
+                j = (j + 1) & pidMapMask;
+            }
+            PidMap[j] = old_map[i];
+        }
+    }
+
+    free(old_map);
+} /* pidmap_grow */
+
+
+/* ------------------------------------------------------------------------
+   Name - pidmap_remove
+   Purpose - forgets a pid, shifting later entries of its probe run back so
+             lookups never have to skip deleted entries
+   Parameters - the pid to remove
+   Returns - nothing
+   Side Effects - PidMap is changed
+   ------------------------------------------------------------------------ */
+static void pidmap_remove(int pid) {
+    int i = pid_hash(pid);
+    int j, home;
+
+    while (PidMap[i] != NULL && PidMap[i]->pid != pid) {
+        i = (i + 1) & pidMapMask;
+    }
+
+    if (PidMap[i] == NULL) {
+        return;
+    }
+
+    PidMap[i] = NULL;
+
+    // move back any entry whose home is at or before the hole we just made
+    for (j = (i + 1) & pidMapMask; PidMap[j] != NULL; j = (j + 1) & pidMapMask) {
+        home = pid_hash(PidMap[j]->pid);
+
+        if (((j - home) & pidMapMask) >= ((j - i) & pidMapMask)) {
+            PidMap[i] = PidMap[j];
+            PidMap[j] = NULL;
+            i = j;
+        }
+    }
+} /* pidmap_remove */
+
+
+/* ------------------------------------------------------------------------
+   Name - find_process
+   Purpose - looks a pid up in PidMap
+   Parameters - the pid to look for
+   Returns - the process with that pid, NULL if it does not exist or has
+             been joined
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+procPtr find_process(int pid) {
+    int i;
+
+    if (PidMap == NULL) {
+        return NULL;
+    }
+
+    i = pid_hash(pid);
+
+    while (PidMap[i] != NULL) {
+        if (PidMap[i]->pid == pid) {
+            return PidMap[i];
+        }
+
+        i = (i + 1) & pidMapMask;
+    }
+
+    return NULL;
+} /* find_process */
+
+
+/* ------------------------------------------------------------------------
+   Name - next_link
+   Purpose - finds the forward link a process uses for the given list
+   Parameters - the process and which list the link belongs to
+   Returns - the address of the process' next pointer for that list
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+static procPtr *next_link(procPtr node, list_to_change which_list) {
+    switch (which_list) {
+        case READYLIST:
+            return &node->nextProcPtr;
+        case QUITLIST:
+            return &node->nextQuitSibling;
+        case CHILDRENLIST:
+            return &node->nextSiblingPtr;
+        case ZAPPERLIST:
+            return &node->nextZapperSibling;
+        case SLEEPLIST:
+            return &node->nextSleeper;
+        case SEMLIST:
+            return &node->nextSemWaiter;
+    }
+
+    return NULL;
+} /* next_link */
+
+
+/* ------------------------------------------------------------------------
+   Name - prev_link
+   Purpose - finds the backward link a process uses for the given list
+   Parameters - the process and which list the link belongs to
+   Returns - the address of the process' prev pointer for that list
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+static procPtr *prev_link(procPtr node, list_to_change which_list) {
+    switch (which_list) {
+        case READYLIST:
+            return &node->prevProcPtr;
+        case QUITLIST:
+            return &node->prevQuitSibling;
+        case CHILDRENLIST:
+            return &node->prevSiblingPtr;
+        case ZAPPERLIST:
+            return &node->prevZapperSibling;
+        case SLEEPLIST:
+            return &node->prevSleeper;
+        case SEMLIST:
+            return &node->prevSemWaiter;
+    }
+
+    return NULL;
+} /* prev_link */
+
+
+/* ------------------------------------------------------------------------
+   Name - delete node
+   Purpose - unlinks a node from a list (ready, quit, children or zapper
+             list) in constant time
+   Parameters - the head and tail of the list, the node to be removed and
+                which list it is
+   Returns - 1 if the node was removed, 0 if it was not on that list
+   Side Effects - removes the specified node from the list
+   ------------------------------------------------------------------------ */
+int delete_node(procPtr *head, procPtr *tail, procPtr to_delete,
+                list_to_change which_list) {
+    procPtr *next, *prev;
+
+    if ((to_delete->onLists & LISTFLAG(which_list)) == 0) {
+        return 0;
+    }
+
+    next = next_link(to_delete, which_list);
+    prev = prev_link(to_delete, which_list);
+
+    if (*prev == NULL) {
+        *head = *next;
+    }
+    else {
+        *next_link(*prev, which_list) = *next;
+    }
+
+    if (*next == NULL) {
+        *tail = *prev;
+    }
+    else {
+        *prev_link(*next, which_list) = *prev;
+    }
+
+    *next = NULL;
+    *prev = NULL;
+    to_delete->onLists &= ~LISTFLAG(which_list);
+
+    return 1;
+} /* deletenode */
+
+
+
+/* ------------------------------------------------------------------------
+   Name - add node
+   Purpose - appends a node to the tail of a list in constant time
+   Parameters - the head and tail of the list, the node to add and which
+                list it is
+   Returns - 1 once the node is added
+   Side Effects - halts if the node is already on a list of that kind
+   ------------------------------------------------------------------------ */
+int add_node(procPtr *head, procPtr *tail, procPtr to_add,
+             list_to_change which_list) {
+
+    if (to_add->onLists & LISTFLAG(which_list)) {
+        USLOSS_Console("THE HORSE HAS POUNCED ON YOU!");
+        USLOSS_Halt(1);
+    }
+
+    *next_link(to_add, which_list) = NULL;
+    *prev_link(to_add, which_list) = *tail;
+
+    if (*tail == NULL) {
+        *head = to_add;
+    }
+    else {
+        *next_link(*tail, which_list) = to_add;
+    }
+
+    *tail = to_add;
+    to_add->onLists |= LISTFLAG(which_list);
+
+    return 1;
+} /* add_node */
+
+
+/* ------------------------------------------------------------------------
+   Name - add_to_readylist
+   Purpose - appends a process to the ReadyList of its priority and marks
+             that priority as non-empty in the ready bitmap, or puts it in
+             the fair heap under SCHED_FAIR
+   Parameters - the process to add
+   Returns - nothing
+   Side Effects - ReadyList, readyBitmap and the ready depth counters are
+                  changed
+   ------------------------------------------------------------------------ */
+static void add_to_readylist(procPtr to_add) {
+    int depth = ++kernelCounts.readyDepth[to_add->priority];
+
+    if (depth > kernelCounts.readyPeak[to_add->priority]) {
+        kernelCounts.readyPeak[to_add->priority] = depth;
+    }
+
+    // under SCHED_FAIR everyone but the sentinel shares one run queue, and
+    // a process that slept does not get credit for the time it was away
+    if (schedPolicy == SCHED_FAIR && to_add->priority <= MINPRIORITY) {
+        if (to_add->vruntime < fairMinVruntime) {
+            to_add->vruntime = fairMinVruntime;
+        }
+        fair_insert(to_add);
+        return;
+    }
+
+    add_node(&ReadyList[to_add->priority], &ReadyTail[to_add->priority],
+             to_add, READYLIST);
+    readyBitmap |= 1u << to_add->priority;
+} /* add_to_readylist */
+
+
+/* ------------------------------------------------------------------------
+   Name - remove_from_readylist
+   Purpose - removes a process from the ReadyList of its priority and clears
+             that priority in the ready bitmap if the list is now empty, or
+             takes it out of the fair heap
+   Parameters - the process to remove
+   Returns - nothing
+   Side Effects - ReadyList, readyBitmap and the ready depth counters are
+                  changed
+   ------------------------------------------------------------------------ */
+static void remove_from_readylist(procPtr to_remove) {
+    if (to_remove->heapIndex != -1) {
+        kernelCounts.readyDepth[to_remove->priority]--;
+        fair_remove(to_remove);
+        return;
+    }
+
+    // only count what was really queued, so the depth cannot drift
+    if (delete_node(&ReadyList[to_remove->priority], &ReadyTail[to_remove->priority],
+                    to_remove, READYLIST)) {
+        kernelCounts.readyDepth[to_remove->priority]--;
+    }
+
+    if (ReadyList[to_remove->priority] == NULL) {
+        readyBitmap &= ~(1u << to_remove->priority);
+    }
+} /* remove_from_readylist */
+
+
+/* ------------------------------------------------------------------------
+   Name - get_stack
+   Purpose - gives a process a stack.  Requests up to the largest size class
+             are rounded up to their class and served from the stack pool
+             when it has one, otherwise the stack is malloc'd.
+   Parameters - the process getting the stack and the requested size
+   Returns - nothing
+   Side Effects - sets stack, stackSize and stackClass of the process,
+                  halts if no memory is left
+   ------------------------------------------------------------------------ */
+static void get_stack(procPtr proc, int stacksize) {
+    int i;
+
+    proc->cold->stackClass = -1;
+    proc->cold->stackSize = stacksize;
+
+#if MMAPSTACKS
+    // mapped stacks are a whole number of pages
+    long page = sysconf(_SC_PAGESIZE);
+    proc->cold->stackSize = (stacksize + page - 1) / page * page;
+#endif
+
+    for (i = 0; i < STACKCLASSES; i++) {
+        if (stacksize <= (USLOSS_MIN_STACK << i)) {
+            proc->cold->stackClass = i;
+            proc->cold->stackSize = USLOSS_MIN_STACK << i;
+            break;
+        }
+    }
+
+    // reuse a pooled stack of this class if there is one
+    if (proc->cold->stackClass != -1 && stackPool[proc->cold->stackClass] != NULL) {
+        proc->cold->stack = stackPool[proc->cold->stackClass];
+        stackPool[proc->cold->stackClass] = *(char **) proc->cold->stack;
+        stackPoolCount[proc->cold->stackClass]--;
+        stackPoolHits++;
+        return;
+    }
+
+    stackPoolMisses++;
+    proc->cold->stack = alloc_stack(proc->cold->stackSize);
+    if (proc->cold->stack == NULL) {
+        USLOSS_Console("fork1(): Error when allocating stack space.\n");
+        USLOSS_Halt(1);
+    }
+} /* get_stack */
+
+
+/* ------------------------------------------------------------------------
+   Name - release_stack
+   Purpose - hands the stack of a reaped process back to the pool, or frees
+             it if it has no size class or its class is at the pool cap
+   Parameters - the process whose stack is released
+   Returns - nothing
+   Side Effects - the process no longer has a stack
+   ------------------------------------------------------------------------ */
+static void release_stack(procPtr proc) {
+    int class = proc->cold->stackClass;
+
+    if (proc->cold->stack == NULL) {
+        return;
+    }
+
+    if (class != -1 && stackPoolCount[class] < stackPoolCap) {
+        *(char **) proc->cold->stack = stackPool[class];
+        stackPool[class] = proc->cold->stack;
+        stackPoolCount[class]++;
+    }
+    else {
+        free_stack(proc->cold->stack, proc->cold->stackSize);
+    }
+
+    proc->cold->stack = NULL;
+} /* release_stack */
+
+
+/* ------------------------------------------------------------------------
+   Name - alloc_stack
+   Purpose - gets memory for a new stack.  With MMAPSTACKS the stack is
+             mapped with an inaccessible guard page below it, so overflowing
+             it faults instead of running into other memory, and its pages
+             are only committed once they are touched.  Otherwise it is
+             malloc'd.
+   Parameters - the size of the stack, a multiple of the page size when
+                MMAPSTACKS is on
+   Returns - the lowest usable address of the stack, NULL if out of memory
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+static char *alloc_stack(unsigned int size) {
+#if MMAPSTACKS
+    long page = sysconf(_SC_PAGESIZE);
+    char *region;
+
+    region = mmap(NULL, size + page, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (region == MAP_FAILED) {
+        return NULL;
+    }
+
+    // stacks grow down, the guard page goes at the low end
+    if (mprotect(region, page, PROT_NONE) != 0) {
+        munmap(region, size + page);
+        return NULL;
+    }
+
+    return region + page;
+#else
+    return malloc(sizeof(char) * size);
+#endif
+} /* alloc_stack */
+
+
+/* ------------------------------------------------------------------------
+   Name - free_stack
+   Purpose - gives the memory of a stack from alloc_stack back to the system
+   Parameters - the stack and its size
+   Returns - nothing
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+static void free_stack(char *stack, unsigned int size) {
+#if MMAPSTACKS
+    long page = sysconf(_SC_PAGESIZE);
+
+    munmap(stack - page, size + page);
+#else
+    free(stack);
+#endif
+} /* free_stack */
+
+
+/* ------------------------------------------------------------------------
+   Name - setStackPoolCap
+   Purpose - changes how many free stacks each size class may keep, freeing
+             any pooled stacks over the new cap
+   Parameters - the new cap, 0 turns pooling off
+   Returns - the old cap, or -1 if the cap is negative
+   Side Effects - stackPool may shrink
+   ------------------------------------------------------------------------ */
+int setStackPoolCap(int cap) {
+    int i, old_cap = stackPoolCap;
+
+    if (cap < 0) {
+        return -1;
+    }
+
+    stackPoolCap = cap;
+
+    for (i = 0; i < STACKCLASSES; i++) {
+        while (stackPoolCount[i] > stackPoolCap) {
+            char *stack = stackPool[i];
+
+            stackPool[i] = *(char **) stack;
+            stackPoolCount[i]--;
+            free_stack(stack, USLOSS_MIN_STACK << i);
+        }
+    }
+
+    return old_cap;
+} /* setStackPoolCap */
+
+
+/* ------------------------------------------------------------------------
+   Name - readStackPoolStats
+   Purpose - reports how often fork1 was served from the stack pool
+   Parameters - where to store the hit and miss counts, either may be NULL
+   Returns - nothing
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+void readStackPoolStats(int *hits, int *misses) {
+    if (hits != NULL) {
+        *hits = stackPoolHits;
+    }
+
+    if (misses != NULL) {
+        *misses = stackPoolMisses;
+    }
+} /* readStackPoolStats */
+
+
+/* ------------------------------------------------------------------------
+   Name -  clock_interrupt_handler
+   Purpose - handles the USLOSS clock interrupt, waking sleepers that
+             are due and preempting the current process once its time
+             slice is used up.  In tickless mode a tick is skipped when
+             tick_needed() says nothing depends on it.
+   Parameters - the device and argument passed by USLOSS, unused
+   Returns - nothing
+   Side Effects - may call the dispatcher
    ------------------------------------------------------------------------ */
 void clock_interrupt_handler(int dev, void *arg) {
-    timeSlice();
+    clockInterrupts++;
+    kernelCounts.clockInterrupts++;
+
+    if (tickless && !tick_needed()) {
+        clockTicksSkipped++;
+        timerNow++;
+
+        // the slice only counts from when someone else could use the CPU
+        if (Current != NULL) {
+            Current->time_slice_start = USLOSS_Clock();
+        }
+        return;
+    }
+
+    // a woken sleeper may outrank the current process
+    if (timer_tick() == 0 || !maybe_dispatch()) {
+        timeSlice();
+    }
 } /* clock_interrupt_handler */
 
 
+/* ------------------------------------------------------------------------
+   Name - setTickless
+   Purpose - turns tickless mode on or off.  When on, clock interrupts
+             return at once unless the current process shares its
+             priority with another ready process or the scheduling policy
+             needs to see time pass.  USLOSS cannot stop the clock device
+             itself, so a skipped tick still costs the interrupt, but not
+             the time slice and CPU accounting work.
+   Parameters - 1 to turn it on, 0 to turn it off
+   Returns - the old setting
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+int setTickless(int on) {
+    int old_setting = tickless;
+
+    tickless = on != 0;
+
+    return old_setting;
+} /* setTickless */
+
+
+/* ------------------------------------------------------------------------
+   Name - readDispatchStats
+   Purpose - reports how often fork1, unblockProc, semaphore handoffs and
+             sleeper wakeups skipped the dispatcher because the current
+             process still outranked everything ready, and how often they
+             ran it
+   Parameters - where to store the two counts, either may be NULL
+   Returns - nothing
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+void readDispatchStats(int *elided, int *performed) {
+    if (elided != NULL) {
+        *elided = dispatchesElided;
+    }
+
+    if (performed != NULL) {
+        *performed = dispatchesPerformed;
+    }
+} /* readDispatchStats */
+
+
+/* ------------------------------------------------------------------------
+   Name - getKernelStats
+   Purpose - reports the kernel's counters, and optionally starts them
+             over so a load test can measure one phase at a time.  A reset
+             zeroes the cumulative counts and sets each priority's peak
+             ready depth to its current depth.
+   Parameters - where to store the counters, may be NULL to only reset,
+                and whether to reset them afterwards
+   Returns - nothing
+   Side Effects - the counters are reset if reset is nonzero
+   ------------------------------------------------------------------------ */
+void getKernelStats(kernelStats *stats, int reset) {
+    int flags = irqSave();
+    int i;
+
+    if (stats != NULL) {
+        *stats = kernelCounts;
+    }
+
+    if (reset) {
+        kernelStats fresh;
+
+        memset(&fresh, 0, sizeof(fresh));
+        for (i = 0; i < AMOUNTPRIORITIES; i++) {
+            fresh.readyDepth[i] = kernelCounts.readyDepth[i];
+            fresh.readyPeak[i] = kernelCounts.readyDepth[i];
+        }
+        kernelCounts = fresh;
+    }
+
+    irqRestore(flags);
+} /* getKernelStats */
+
+
+/* ------------------------------------------------------------------------
+   Name - readClockStats
+   Purpose - reports how many clock interrupts were taken and how many of
+             them tickless mode skipped
+   Parameters - where to store the two counts, either may be NULL
+   Returns - nothing
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+void readClockStats(int *interrupts, int *skipped) {
+    if (interrupts != NULL) {
+        *interrupts = clockInterrupts;
+    }
+
+    if (skipped != NULL) {
+        *skipped = clockTicksSkipped;
+    }
+} /* readClockStats */
+
+
 
 /* ------------------------------------------------------------------------
    Name -  readCurStartTime
-   Purpose -
-   Parameters -
-   Returns -
-   Side Effects -
+   Purpose - reports when the current process' time slice started
+   Parameters - none
+   Returns - the USLOSS_Clock() time in microseconds
+   Side Effects - none
    ------------------------------------------------------------------------ */
 int readCurStartTime() {
     return Current->time_slice_start;
@@ -772,271 +1716,1762 @@ int readCurStartTime() {
 
 
 /* ------------------------------------------------------------------------
-   Name -  dumpProcesses
+   Name -  dumpProcesses
+   Purpose - prints the process table, with each process' CPU time in
+             microseconds and number of unjoined children
+   Parameters - none
+   Returns - nothing
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+void dumpProcesses() {
+    dumpFilter all = {-1, -1, -1, DUMP_TABLE};
+
+    dumpProcessesFiltered(&all);
+} /* dumpProcesses */
+
+
+/* ------------------------------------------------------------------------
+   Name -  dumpProcessesFiltered
+   Purpose - prints the processes in use that match a filter, as the
+             dumpProcesses() table, as CSV with a header line or as one
+             JSON object per line.  Entries are read in place and the
+             lines gathered into dumpBuf, which is written out each time
+             it fills, so even a large table takes a few writes.
+   Parameters - the filter, NULL for every process as a table
+   Returns - the number of processes printed, -1 if the format is unknown
+             or the filter's rootPid is not in use
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+int dumpProcessesFiltered(dumpFilter *filter) {
+    static char *headers[] = {
+        "PID\tParent  Priority\tStatus\t\t# Kids  CPUtime Name\n",
+        "pid,parent,priority,status,kids,cputime,name\n",
+        ""
+    };
+    dumpFilter all = {-1, -1, -1, DUMP_TABLE};
+    procPtr root = NULL;
+    procPtr proc;
+    int i, len, dumped = 0;
+
+    if (filter == NULL) {
+        filter = &all;
+    }
+
+    if (filter->format < DUMP_TABLE || filter->format > DUMP_JSON) {
+        return -1;
+    }
+
+    if (filter->rootPid != -1) {
+        root = find_process(filter->rootPid);
+        if (root == NULL) {
+            return -1;
+        }
+    }
+
+    len = strlen(strcpy(dumpBuf, headers[filter->format]));
+
+    for (i = 0; i < procSlots; i++) {
+        proc = proc_slot(i);
+
+        if (proc->status == UNUSED ||
+            (filter->status != -1 && proc->status != filter->status) ||
+            (filter->priority != -1 && proc->priority != filter->priority) ||
+            (root != NULL && !in_subtree(proc, root))) {
+            continue;
+        }
+
+        if (len > DUMPBUFSIZE - DUMPLINE) {
+            fwrite(dumpBuf, 1, len, stdout);
+            len = 0;
+        }
+
+        len += dump_line(dumpBuf + len, proc, filter->format);
+        dumped++;
+    }
+
+    if (filter->format == DUMP_TABLE) {
+        if (len > DUMPBUFSIZE - DUMPLINE) {
+            fwrite(dumpBuf, 1, len, stdout);
+            len = 0;
+        }
+
+        len += sprintf(dumpBuf + len, "%d ready, %d blocked, %d join blocked, "
+                       "%d zap blocked, %d quit\n", statusCount[READY],
+                       statusCount[BLOCKED], statusCount[JOIN_BLOCKED],
+                       statusCount[ZAP_BLOCKED], statusCount[QUIT]);
+    }
+
+    fwrite(dumpBuf, 1, len, stdout);
+    fflush(stdout);
+
+    return dumped;
+} /* dumpProcessesFiltered */
+
+
+/* ------------------------------------------------------------------------
+   Name - dump_line
+   Purpose - formats one process for dumpProcessesFiltered()
+   Parameters - where to put the line, at least DUMPLINE bytes, the
+                process and a dump_format
+   Returns - the length of the line
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+static int dump_line(char *line, procPtr proc, int format) {
+    int parent = proc->parentProcPtr == NULL ? -2 : proc->parentProcPtr->pid;
+    int len;
+
+    if (format == DUMP_TABLE) {
+        return sprintf(line, "%5d\t%5d\t%10d\t%5d\t%8d\t%5d\t%s\t\n",
+                       proc->pid, parent, proc->priority, proc->status,
+                       proc->num_children, cpu_time(proc), proc->cold->name);
+    }
+
+    len = sprintf(line, format == DUMP_CSV ? "%d,%d,%d,%d,%d,%d," :
+                  "{\"pid\":%d,\"parent\":%d,\"priority\":%d,\"status\":%d,"
+                  "\"kids\":%d,\"cputime\":%d,\"name\":", proc->pid, parent,
+                  proc->priority, proc->status, proc->num_children,
+                  cpu_time(proc));
+    len += dump_name(line + len, proc->cold->name, format);
+
+    return len + sprintf(line + len, format == DUMP_CSV ? "\n" : "}\n");
+} /* dump_line */
+
+
+/* ------------------------------------------------------------------------
+   Name - dump_name
+   Purpose - quotes a process name for CSV, doubling its quotes, or for
+             JSON, escaping quotes, backslashes and control characters
+   Parameters - where to put it, the name and a dump_format
+   Returns - the length of the quoted name
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+static int dump_name(char *out, char *name, int format) {
+    int len = 0;
+
+    out[len++] = '"';
+
+    for ( ; *name != '\0'; name++) {
+        if (*name == '"') {
+            out[len++] = format == DUMP_CSV ? '"' : '\\';
+            out[len++] = '"';
+        }
+        else if (format == DUMP_JSON && *name == '\\') {
+            out[len++] = '\\';
+            out[len++] = '\\';
+        }
+        else if (format == DUMP_JSON && (unsigned char) *name < ' ') {
+            len += sprintf(out + len, "\\u%04x", (unsigned char) *name);
+        }
+        else {
+            out[len++] = *name;
+        }
+    }
+
+    out[len++] = '"';
+    out[len] = '\0';
+
+    return len;
+} /* dump_name */
+
+
+/* ------------------------------------------------------------------------
+   Name - in_subtree
+   Purpose - tells whether a process is root or one of its descendants,
+             by following parentProcPtr up from it
+   Parameters - the process and the root of the subtree
+   Returns - 1 if it is in the subtree, 0 if not
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+static int in_subtree(procPtr proc, procPtr root) {
+    for ( ; proc != NULL; proc = proc->parentProcPtr) {
+        if (proc == root) {
+            return 1;
+        }
+    }
+
+    return 0;
+} /* in_subtree */
+
+
+/* ------------------------------------------------------------------------
+   Name - zap
+   Purpose -
+   Parameters -
+   Returns -
+   Side Effects -
+   ------------------------------------------------------------------------ */
+int zap(int pid) {
+    procPtr process_to_zap;
+    int flags;
+
+
+    // check calling process is not zapped itself
+    if (isZapped()) {
+        return -1;
+    }
+
+
+    // check if you tried to zap yourself
+    if (Current->pid == pid) {
+        USLOSS_Console("zap(): process %d tried to zap itself.  Halting...\n", Current->pid);
+        USLOSS_Halt(1);
+    }
+
+
+    // look the target up with interrupts off, so it cannot quit and be
+    // reaped, and its slot reused, before it is marked
+    flags = irqSave();
+    process_to_zap = find_process(pid);
+
+
+    // check zapped process exists and that it is not itself
+    if (process_to_zap == NULL) {
+        USLOSS_Console("zap(): process being zapped does not exist.  Halting...\n");
+        USLOSS_Halt(1);
+    }
+
+    
+    // if process has quit then return 0
+    if (process_to_zap->status == QUIT) {
+        irqRestore(flags);
+        return 0;
+    }
+
+
+    // set the statuses
+    process_to_zap->zapped = 1;
+    kernelCounts.zaps++;
+    set_status(Current, ZAP_BLOCKED);
+
+
+    // set the zapped pointer to the zapped process
+    Current->zappedProcPtr = process_to_zap;
+    TRACE(TRACE_ZAP, Current->pid, pid, Current->priority);
+
+
+    // add current process to list of zappers, and delete Current off readylist
+    remove_from_readylist(Current);
+    add_node(&process_to_zap->zappersProcPtr, &process_to_zap->zappersTailPtr,
+             Current, ZAPPERLIST);
+    refresh_priority(process_to_zap);
+    check_wait_cycle(Current);
+
+
+    dispatcher();
+    irqRestore(flags);
+
+    // check calling process is not zapped itself
+    if (isZapped()) {
+        return -1;
+    }
+
+    return 0;
+} /* zap */
+
+
+/* ------------------------------------------------------------------------
+   Name - zapMany
+   Purpose - zaps a set of processes at once, blocking until all of them
+             have quit.  Every target is marked zapped up front, and the
+             caller waits on one target at a time, moving on to the next
+             as each quits, so it is only woken once, when all are done.
+   Parameters - the pids to zap, and how many there are
+   Returns - 0 once every target has quit, -1 if the caller was zapped
+   Side Effects - the caller may be blocked
+   ------------------------------------------------------------------------ */
+int zapMany(int *pids, int n) {
+    procPtr process_to_zap;
+    int i;
+    int flags;
+
+    // check calling process is not zapped itself
+    if (isZapped()) {
+        return -1;
+    }
+
+
+    // check every target exists and is not us, then mark it zapped
+    flags = irqSave();
+    for (i = 0; i < n; i++) {
+        process_to_zap = find_process(pids[i]);
+
+        if (pids[i] == Current->pid) {
+            USLOSS_Console("zapMany(): process %d tried to zap itself.  Halting...\n", Current->pid);
+            USLOSS_Halt(1);
+        }
+
+        if (process_to_zap == NULL) {
+            USLOSS_Console("zapMany(): process %d being zapped does not exist.  Halting...\n", pids[i]);
+            USLOSS_Halt(1);
+        }
+
+        if (process_to_zap->status != QUIT) {
+            process_to_zap->zapped = 1;
+            kernelCounts.zaps++;
+        }
+    }
+
+
+    // wait on the first target that has not quit yet
+    Current->zapPids = pids;
+    Current->zapCount = n;
+
+    if (!zap_next(Current)) {
+        irqRestore(flags);
+        return 0;
+    }
+
+    set_status(Current, ZAP_BLOCKED);
+    remove_from_readylist(Current);
+    check_wait_cycle(Current);
+
+
+    dispatcher();
+    irqRestore(flags);
+
+    // check calling process is not zapped itself
+    if (isZapped()) {
+        return -1;
+    }
+
+    return 0;
+} /* zapMany */
+
+
+/* ------------------------------------------------------------------------
+   Name - zap_next
+   Purpose - puts a zapMany() caller on the zapper list of the next of
+             its targets that has not quit yet
+   Parameters - the zapping process
+   Returns - 1 if it is waiting on another target, 0 if none are left
+   Side Effects - the zapper's zapPids and zapCount move past the targets
+                  that have quit
+   ------------------------------------------------------------------------ */
+static int zap_next(procPtr zapper) {
+    procPtr target;
+
+    while (zapper->zapCount > 0) {
+        // a target may have quit and been joined since zapMany() was called
+        target = find_process(zapper->zapPids[0]);
+        zapper->zapPids++;
+        zapper->zapCount--;
+
+        if (target != NULL && target->status != QUIT) {
+            zapper->zappedProcPtr = target;
+            TRACE(TRACE_ZAP, zapper->pid, target->pid, zapper->priority);
+            add_node(&target->zappersProcPtr, &target->zappersTailPtr,
+                     zapper, ZAPPERLIST);
+            refresh_priority(target);
+            return 1;
+        }
+    }
+
+    return 0;
+} /* zap_next */
+
+
+/* ------------------------------------------------------------------------
+   Name - isZapped
+   Purpose - 
+   Parameters -
+   Returns -
+   Side Effects -
+   ------------------------------------------------------------------------ */
+int isZapped() {
+    return Current->zapped;
+} /* isZapped */
+
+
+/* ------------------------------------------------------------------------
+   Name - getPid
+   Purpose -
+   Parameters -
+   Returns -
+   Side Effects -
+   ------------------------------------------------------------------------ */
+int getpid() {
+    return Current->pid;
+} /* getpid */
+
+
+/* ------------------------------------------------------------------------
+   Name - blockMe
+   Purpose -
+   Parameters -
+   Returns -
+   Side Effects -
+   ------------------------------------------------------------------------ */
+int blockMe(int newStatus) {
+    int flags;
+
+    // halt and print error message if newstatus is not a block status
+    if (newStatus < 10) {
+        USLOSS_Console("blockMe(): newStatus parameter is less than 10.\n");
+        USLOSS_Halt(1);
+    }
+
+    
+    // process attempted to block while zapped
+    if (isZapped()) {
+        return -1;
+    }
+
+
+    // change status and take off the ReadyList
+    flags = irqSave();
+    kernelCounts.blocks++;
+    block_current(newStatus);
+
+
+    // call dispatcher then check if process was zapped while blocked
+    dispatcher();
+    irqRestore(flags);
+
+    if (isZapped()) {
+        return -1;
+    }
+
+    return 0;
+} /* blockMe */
+
+
+/* ------------------------------------------------------------------------
+   Name - sleepTicks
+   Purpose - blocks the current process until the given number of clock
+             interrupts have happened, the first of which may be only
+             moments away
+   Parameters - the number of clock interrupts to sleep through
+   Returns - -1 if the process was zapped, 0 otherwise
+   Side Effects - the process is put on the timer wheel and blocked
+   ------------------------------------------------------------------------ */
+int sleepTicks(int ticks) {
+    int flags;
+
+    if (isZapped()) {
+        return -1;
+    }
+
+    if (ticks <= 0) {
+        return 0;
+    }
+
+    flags = irqSave();
+    Current->wakeTick = timerNow + ticks;
+    sleepCount++;
+    timer_insert(Current);
+
+    block_current(SLEEP_BLOCKED);
+
+
+    // call dispatcher then check if process was zapped while asleep
+    dispatcher();
+    irqRestore(flags);
+
+    if (isZapped()) {
+        return -1;
+    }
+
+    return 0;
+} /* sleepTicks */
+
+
+/* ------------------------------------------------------------------------
+   Name - sleepUs
+   Purpose - blocks the current process for at least the given number of
+             microseconds, rounded up to whole clock interrupts
+   Parameters - the number of microseconds to sleep
+   Returns - -1 if the process was zapped, 0 otherwise
+   Side Effects - the process is put on the timer wheel and blocked
+   ------------------------------------------------------------------------ */
+int sleepUs(int us) {
+    if (us <= 0) {
+        return sleepTicks(0);
+    }
+
+    // one more tick covers the part of a tick that has already gone by
+    return sleepTicks(us / TICKUS + 1);
+} /* sleepUs */
+
+
+/* ------------------------------------------------------------------------
+   Name - semCreate
+   Purpose - makes a new semaphore
+   Parameters - the starting count, 0 or more
+   Returns - the semaphore's id, -1 if none are free or value is negative
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+int semCreate(int value) {
+    return sem_create(value, 0);
+} /* semCreate */
+
+
+/* ------------------------------------------------------------------------
+   Name - semFree
+   Purpose - frees a semaphore nobody is waiting on
+   Parameters - the semaphore's id
+   Returns - 0 if freed, -1 if there is no such semaphore or processes
+             are waiting on it
+   Side Effects - the id may be handed out again by semCreate/mutexCreate
+   ------------------------------------------------------------------------ */
+int semFree(int sem) {
+    return sem_free(sem, 0);
+} /* semFree */
+
+
+/* ------------------------------------------------------------------------
+   Name - semP
+   Purpose - takes one from a semaphore's count, waiting in FIFO order
+             behind any other waiters while the count is 0
+   Parameters - the semaphore's id
+   Returns - 0 once the semaphore was taken, -1 if there is no such
+             semaphore
+   Side Effects - the process may be blocked
+   ------------------------------------------------------------------------ */
+int semP(int sem) {
+    semStruct *semaphore = sem_lookup(sem, 0);
+    int flags;
+
+    if (semaphore == NULL) {
+        return -1;
+    }
+
+    flags = irqSave();
+    if (semaphore->value > 0) {
+        semaphore->value--;
+    }
+    else {
+        sem_wait(semaphore, sem, SEM_BLOCKED);
+    }
+    irqRestore(flags);
+
+    return 0;
+} /* semP */
+
+
+/* ------------------------------------------------------------------------
+   Name - semV
+   Purpose - adds one to a semaphore's count.  If a process is waiting
+             the count is handed straight to the first waiter instead,
+             and it only runs now if it outranks the caller.
+   Parameters - the semaphore's id
+   Returns - 0, or -1 if there is no such semaphore
+   Side Effects - a waiter may be unblocked
+   ------------------------------------------------------------------------ */
+int semV(int sem) {
+    semStruct *semaphore = sem_lookup(sem, 0);
+    int flags;
+
+    if (semaphore == NULL) {
+        return -1;
+    }
+
+    flags = irqSave();
+    if (semaphore->waitHead != NULL) {
+        sem_handoff(semaphore);
+    }
+    else {
+        semaphore->value++;
+    }
+    irqRestore(flags);
+
+    return 0;
+} /* semV */
+
+
+/* ------------------------------------------------------------------------
+   Name - mutexCreate
+   Purpose - makes a new, unlocked mutex
+   Parameters - none
+   Returns - the mutex's id, -1 if none are free
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+int mutexCreate() {
+    return sem_create(0, 1);
+} /* mutexCreate */
+
+
+/* ------------------------------------------------------------------------
+   Name - mutexFree
+   Purpose - frees an unlocked mutex
+   Parameters - the mutex's id
+   Returns - 0 if freed, -1 if there is no such mutex or it is locked
+   Side Effects - the id may be handed out again by semCreate/mutexCreate
+   ------------------------------------------------------------------------ */
+int mutexFree(int mutex) {
+    semStruct *lock = sem_lookup(mutex, 1);
+
+    if (lock == NULL || lock->ownerPid != -1) {
+        return -1;
+    }
+
+    return sem_free(mutex, 1);
+} /* mutexFree */
+
+
+/* ------------------------------------------------------------------------
+   Name - mutexLock
+   Purpose - locks a mutex, waiting in FIFO order behind any other waiters
+             while another process holds it.  A wait that closes a cycle
+             of waits halts USLOSS as a deadlock.
+   Parameters - the mutex's id
+   Returns - 0 once the mutex is held, -1 if there is no such mutex or
+             the process already holds it
+   Side Effects - the process may be blocked
+   ------------------------------------------------------------------------ */
+int mutexLock(int mutex) {
+    semStruct *lock = sem_lookup(mutex, 1);
+    int flags;
+
+    if (lock == NULL || lock->ownerPid == Current->pid) {
+        return -1;
+    }
+
+    flags = irqSave();
+    if (lock->ownerPid == -1) {
+        lock->ownerPid = Current->pid;
+    }
+    else {
+        sem_wait(lock, mutex, MUTEX_BLOCKED);
+    }
+    irqRestore(flags);
+
+    return 0;
+} /* mutexLock */
+
+
+/* ------------------------------------------------------------------------
+   Name - mutexUnlock
+   Purpose - unlocks a mutex.  If a process is waiting the mutex is handed
+             straight to the first waiter, which only runs now if it
+             outranks the caller.
+   Parameters - the mutex's id
+   Returns - 0, or -1 if there is no such mutex or the process does not
+             hold it
+   Side Effects - a waiter may be unblocked
+   ------------------------------------------------------------------------ */
+int mutexUnlock(int mutex) {
+    semStruct *lock = sem_lookup(mutex, 1);
+    int flags;
+
+    if (lock == NULL || lock->ownerPid != Current->pid) {
+        return -1;
+    }
+
+    flags = irqSave();
+    if (lock->waitHead != NULL) {
+        sem_handoff(lock);
+    }
+    else {
+        lock->ownerPid = -1;
+    }
+    irqRestore(flags);
+
+    return 0;
+} /* mutexUnlock */
+
+
+
+
+/* ------------------------------------------------------------------------
+   Name - unblockProc
+   Purpose -
+   Parameters -
+   Returns -
+   Side Effects -
+   ------------------------------------------------------------------------ */
+int unblockProc(int pid) {
+    int flags = irqSave();
+
+    kernelCounts.unblocks++;
+    unblockRegularProc(pid);
+    maybe_dispatch();
+    irqRestore(flags);
+
+    return 0;
+} /* unblockProc */
+
+
+/* ------------------------------------------------------------------------
+   Name - unblockRegularProc
+   Purpose -
+   Parameters -
+   Returns -
+   Side Effects -
+   ------------------------------------------------------------------------ */
+int unblockRegularProc(int pid) {
+    procPtr process_to_unblock;
+
+    process_to_unblock = find_process(pid);
+
+    // nothing to wake if the process is gone or has quit, and semaphore
+    // waiters are only woken by sem_handoff()
+    if (process_to_unblock == NULL || process_to_unblock->status == QUIT ||
+        (process_to_unblock->onLists & LISTFLAG(SEMLIST))) {
+        return -2;
+    }
+
+    // already on the ReadyList, nothing to do
+    if (process_to_unblock->status == READY) {
+        return 0;
+    }
+
+    // woken early from sleepTicks()
+    if (process_to_unblock->onLists & LISTFLAG(SLEEPLIST)) {
+        timer_cancel(process_to_unblock);
+    }
+
+    // change the status of the process to READY and put it into the ReadyList
+    set_status(process_to_unblock, READY);
+    add_to_readylist(process_to_unblock);
+    TRACE(TRACE_UNBLOCK, pid, Current == NULL ? -1 : Current->pid,
+          process_to_unblock->priority);
+
+
+    return 0;
+} /* unblockRegularProc */
+
+
+/* ------------------------------------------------------------------------
+   Name - timeSlice
+   Purpose - round robins the current process to the back of its ReadyList
+             once it has run for a full quantum
+   Parameters - none
+   Returns - nothing
+   Side Effects - may call the dispatcher
+   ------------------------------------------------------------------------ */
+void timeSlice() {
+    int current_time = USLOSS_Clock();
+
+    if (timeSliceQuantum == 0 || Current == NULL) {
+        return;
+    }
+
+    // MLFQ periodically puts everyone back at their fork1 priority so
+    // demoted processes do not starve
+    if (schedPolicy == SCHED_MLFQ && current_time - lastBoost >= MLFQBOOST) {
+        lastBoost = current_time;
+        mlfq_boost();
+    }
+
+    // keep the vruntime of the running process current for SCHED_FAIR
+    charge_cpu(Current, current_time);
+
+    if (current_time - Current->time_slice_start >= timeSliceQuantum) {
+        // start a fresh slice in case nothing else is ready at this priority
+        Current->time_slice_start = current_time;
+
+        // using a whole quantum costs a level under MLFQ, never down to the
+        // sentinel's
+        if (schedPolicy == SCHED_MLFQ && Current->own_priority < MINPRIORITY) {
+            Current->own_priority++;
+            refresh_priority(Current);
+        }
+
+        dispatcher();
+    }
+} /* timeSlice */
+
+
+/* ------------------------------------------------------------------------
+   Name - set_priority
+   Purpose - moves a process to another priority level, to the tail of
+             that level's ReadyList if it is ready
+   Parameters - the process and its new priority
+   Returns - nothing
+   Side Effects - ReadyList and readyBitmap may change
+   ------------------------------------------------------------------------ */
+static void set_priority(procPtr proc, int priority) {
+    if (proc->priority == priority) {
+        return;
+    }
+
+    if (proc->status == READY) {
+        remove_from_readylist(proc);
+        proc->priority = priority;
+        add_to_readylist(proc);
+    }
+    else {
+        proc->priority = priority;
+    }
+} /* set_priority */
+
+
+/* ------------------------------------------------------------------------
+   Name - mlfq_boost
+   Purpose - returns every process to the priority it was forked with
+   Parameters - none
+   Returns - nothing
+   Side Effects - ReadyList and readyBitmap may change
+   ------------------------------------------------------------------------ */
+static void mlfq_boost(void) {
+    int i;
+
+    for (i = 0; i < procSlots; i++) {
+        procPtr proc = proc_slot(i);
+
+        if (proc->status != UNUSED) {
+            proc->own_priority = proc->base_priority;
+            refresh_priority(proc);
+        }
+    }
+} /* mlfq_boost */
+
+
+/* ------------------------------------------------------------------------
+   Name - refresh_priority
+   Purpose - works out the priority a process should run at: its own,
+             unless priority inheritance is on and a process waiting on it
+             (a zapper, or its parent blocked in join) has a better one.
+             A change is passed on to whatever this process is itself
+             waiting on, so boosts follow chains of waits.
+   Parameters - the process
+   Returns - nothing
+   Side Effects - the priority of this and other processes may change
+   ------------------------------------------------------------------------ */
+static void refresh_priority(procPtr proc) {
+    int best = proc->own_priority;
+    procPtr parent = proc->parentProcPtr;
+    procPtr scout;
+
+    if (priorityInheritance) {
+        for (scout = proc->zappersProcPtr; scout != NULL; scout = scout->nextZapperSibling) {
+            if (scout->priority < best) {
+                best = scout->priority;
+            }
+        }
+
+        if (parent != NULL && parent->status == JOIN_BLOCKED &&
+            (parent->joinTarget == NULL || parent->joinTarget == proc) &&
+            parent->priority < best) {
+            best = parent->priority;
+        }
+    }
+
+    if (best == proc->priority) {
+        return;
+    }
+
+    set_priority(proc, best);
+
+    if (proc->status == ZAP_BLOCKED) {
+        refresh_priority(proc->zappedProcPtr);
+    }
+    else if (proc->status == JOIN_BLOCKED) {
+        for (scout = proc->childProcPtr; scout != NULL; scout = scout->nextSiblingPtr) {
+            refresh_priority(scout);
+        }
+    }
+} /* refresh_priority */
+
+
+/* ------------------------------------------------------------------------
+   Name - setPriorityInheritance
+   Purpose - turns priority inheritance on or off.  When on, a process
+             blocked in zap lends its priority to the process it zapped,
+             and a parent blocked in join lends its priority to its
+             children, until the wait ends.
+   Parameters - 1 to turn it on, 0 to turn it off
+   Returns - the old setting
+   Side Effects - priorities of every process are worked out again
+   ------------------------------------------------------------------------ */
+int setPriorityInheritance(int on) {
+    int old_setting = priorityInheritance;
+    int flags = irqSave();
+    int i;
+
+    priorityInheritance = on != 0;
+
+    for (i = 0; i < procSlots; i++) {
+        if (proc_slot(i)->status != UNUSED) {
+            refresh_priority(proc_slot(i));
+        }
+    }
+
+    irqRestore(flags);
+    return old_setting;
+} /* setPriorityInheritance */
+
+
+/* ------------------------------------------------------------------------
+   Name - setSchedPolicy
+   Purpose - chooses how the dispatcher orders processes.  SCHED_FIXED
+             keeps every process at its fork1 priority.  SCHED_MLFQ drops a
+             process a level each time it uses a full quantum, raises it a
+             level (up to its fork1 priority) each time it blocks in
+             blockMe or join, and boosts everyone back to their fork1
+             priority every MLFQBOOST microseconds.  SCHED_FAIR runs the
+             ready process with the least weighted CPU time, so every
+             priority gets a share of the CPU in proportion to its weight.
+   Parameters - the policy, meant to be set once by start1
+   Returns - the old policy, or -1 if the policy is unknown
+   Side Effects - switching back to SCHED_FIXED restores fork1 priorities
+   ------------------------------------------------------------------------ */
+int setSchedPolicy(int policy) {
+    int old_policy = schedPolicy;
+    int flags;
+    int i;
+
+    if (policy != SCHED_FIXED && policy != SCHED_MLFQ && policy != SCHED_FAIR) {
+        return -1;
+    }
+
+    // the run queues are empty in between, a clock tick must not see that
+    flags = irqSave();
+
+    // take every ready process out of the old policy's run queue...
+    for (i = 0; i < procSlots; i++) {
+        if (proc_slot(i)->status == READY) {
+            remove_from_readylist(proc_slot(i));
+        }
+    }
+
+    schedPolicy = policy;
+    lastBoost = USLOSS_Clock();
+
+    // undo MLFQ demotions while nobody is queued, set_priority() would
+    // queue a ready process again
+    if (policy != SCHED_MLFQ) {
+        for (i = 0; i < procSlots; i++) {
+            procPtr proc = proc_slot(i);
+
+            if (proc->status != UNUSED) {
+                proc->own_priority = proc->base_priority;
+                proc->priority = proc->base_priority;
+            }
+        }
+    }
+
+    // ...and put it in the new one's
+    for (i = 0; i < procSlots; i++) {
+        if (proc_slot(i)->status == READY) {
+            add_to_readylist(proc_slot(i));
+        }
+    }
+
+    // with everyone queued again, lend inherited priorities back out
+    if (policy != SCHED_MLFQ && priorityInheritance) {
+        for (i = 0; i < procSlots; i++) {
+            if (proc_slot(i)->status != UNUSED) {
+                refresh_priority(proc_slot(i));
+            }
+        }
+    }
+
+    irqRestore(flags);
+    return old_policy;
+} /* setSchedPolicy */
+
+
+/* ------------------------------------------------------------------------
+   Name - charge_cpu
+   Purpose - charges a process for the CPU it used since it was last
+             charged.  Under SCHED_FAIR its vruntime grows by that time
+             scaled by FAIRWEIGHT over its priority's weight, so higher
+             priorities age more slowly and get a bigger share.  A process
+             that just blocked or quit has already left the fair heap, but
+             its last stretch of CPU is charged all the same.
+   Parameters - the process and the current USLOSS_Clock() time
+   Returns - nothing
+   Side Effects - the process may move down the fair heap
+   ------------------------------------------------------------------------ */
+static void charge_cpu(procPtr proc, int now) {
+    int used = now - proc->charge_start;
+
+    proc->total_time_used += used;
+    proc->charge_start = now;
+
+    if (schedPolicy == SCHED_FAIR && proc->priority <= MINPRIORITY) {
+        proc->vruntime += (long long) used * FAIRWEIGHT / fairWeight[proc->priority];
+
+        if (proc->heapIndex != -1) {
+            fair_sift_down(proc->heapIndex);
+        }
+    }
+} /* charge_cpu */
+
+
+/* ------------------------------------------------------------------------
+   Name - fair_insert
+   Purpose - adds a ready process to the fair heap
+   Parameters - the process
+   Returns - nothing
+   Side Effects - FairHeap may grow, halts if out of memory
+   ------------------------------------------------------------------------ */
+static void fair_insert(procPtr proc) {
+    if (fairCount == fairCapacity) {
+        int capacity = fairCapacity == 0 ? PROCCHUNK : 2 * fairCapacity;
+        procPtr *heap = realloc(FairHeap, capacity * sizeof(procPtr));
+
+        if (heap == NULL) {
+            USLOSS_Console("fair_insert(): out of memory.  Halting...\n");
+            USLOSS_Halt(1);
+        }
+
+        FairHeap = heap;
+        fairCapacity = capacity;
+    }
+
+    FairHeap[fairCount] = proc;
+    proc->heapIndex = fairCount++;
+    fair_sift_up(proc->heapIndex);
+} /* fair_insert */
+
+
+/* ------------------------------------------------------------------------
+   Name - fair_remove
+   Purpose - takes a process out of the fair heap, filling its place with
+             the last entry
+   Parameters - the process
+   Returns - nothing
+   Side Effects - FairHeap is changed
+   ------------------------------------------------------------------------ */
+static void fair_remove(procPtr proc) {
+    int i = proc->heapIndex;
+
+    proc->heapIndex = -1;
+    fairCount--;
+
+    if (i == fairCount) {
+        return;
+    }
+
+    FairHeap[i] = FairHeap[fairCount];
+    FairHeap[i]->heapIndex = i;
+    fair_sift_up(i);
+    fair_sift_down(FairHeap[i]->heapIndex);
+} /* fair_remove */
+
+
+/* ------------------------------------------------------------------------
+   Name - fair_sift_up
+   Purpose - moves a fair heap entry up until its parent's vruntime is no
+             larger
+   Parameters - the entry's index
+   Returns - nothing
+   Side Effects - FairHeap is changed
+   ------------------------------------------------------------------------ */
+static void fair_sift_up(int i) {
+    procPtr proc = FairHeap[i];
+
+    while (i > 0 && FairHeap[(i - 1) / 2]->vruntime > proc->vruntime) {
+        FairHeap[i] = FairHeap[(i - 1) / 2];
+        FairHeap[i]->heapIndex = i;
+        i = (i - 1) / 2;
+    }
+
+    FairHeap[i] = proc;
+    proc->heapIndex = i;
+} /* fair_sift_up */
+
+
+/* ------------------------------------------------------------------------
+   Name - fair_sift_down
+   Purpose - moves a fair heap entry down until neither child has a smaller
+             vruntime
+   Parameters - the entry's index
+   Returns - nothing
+   Side Effects - FairHeap is changed
+   ------------------------------------------------------------------------ */
+static void fair_sift_down(int i) {
+    procPtr proc = FairHeap[i];
+    int child;
+
+    while ((child = 2 * i + 1) < fairCount) {
+        if (child + 1 < fairCount &&
+            FairHeap[child + 1]->vruntime < FairHeap[child]->vruntime) {
+            child++;
+        }
+
+        if (FairHeap[child]->vruntime >= proc->vruntime) {
+            break;
+        }
+
+        FairHeap[i] = FairHeap[child];
+        FairHeap[i]->heapIndex = i;
+        i = child;
+    }
+
+    FairHeap[i] = proc;
+    proc->heapIndex = i;
+} /* fair_sift_down */
+
+
+/* ------------------------------------------------------------------------
+   Name - setTimeSlice
+   Purpose - changes the time slice quantum
+   Parameters - the new quantum in microseconds, 0 turns preemption off
+   Returns - the old quantum, or -1 if the new one is negative
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+int setTimeSlice(int quantum) {
+    int old_quantum = timeSliceQuantum;
+
+    if (quantum < 0) {
+        return -1;
+    }
+
+    timeSliceQuantum = quantum;
+
+    return old_quantum;
+} /* setTimeSlice */
+
+
+
+/* ------------------------------------------------------------------------
+   Name - readtime
+   Purpose - reports the CPU time used by the current process
+   Parameters - none
+   Returns - the CPU time in microseconds, including the running slice
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+int readtime() {
+    return cpu_time(Current);
+} /* readtime */
+
+
+/* ------------------------------------------------------------------------
+   Name - cpu_time
+   Purpose - totals the CPU time a process has used.  A process is only
+             charged by the dispatcher and on clock ticks, so the running
+             process also gets the time since it was last charged.
+   Parameters - the process
+   Returns - the CPU time in microseconds
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+static int cpu_time(procPtr proc) {
+    if (proc == Current) {
+        return proc->total_time_used + USLOSS_Clock() - proc->charge_start;
+    }
+
+    return proc->total_time_used;
+} /* cpu_time */
+
+
+
+#if SCHEDTRACE
+/* ------------------------------------------------------------------------
+   Name - trace_event
+   Purpose - records a scheduler event in the trace ring, overwriting the
+             oldest event once the ring is full
+   Parameters - the TRACE_ event type, the pid it is about, the other pid
+                or value for that type and the priority
+   Returns - nothing
+   Side Effects - TraceRing is changed
+   ------------------------------------------------------------------------ */
+static void trace_event(int type, int pid, int other, int priority) {
+    traceEvent *event = &TraceRing[traceNext++ % TRACESIZE];
+
+    event->time = USLOSS_Clock();
+    event->type = type;
+    event->priority = priority;
+    event->pid = pid;
+    event->other = other;
+} /* trace_event */
+#endif
+
+
+/* ------------------------------------------------------------------------
+   Name - readTrace
+   Purpose - copies the most recent scheduler events out of the trace ring
+   Parameters - where to copy the events and how many fit there
+   Returns - the number of events copied, oldest first.  Always 0 when the
+             kernel is built with SCHEDTRACE off.
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+int readTrace(traceEvent *events, int max) {
+    int count = 0;
+
+#if SCHEDTRACE
+    unsigned int first;
+
+    count = traceNext < TRACESIZE ? traceNext : TRACESIZE;
+    if (count > max) {
+        count = max;
+    }
+
+    for (first = traceNext - count; first != traceNext; first++) {
+        *events++ = TraceRing[first % TRACESIZE];
+    }
+#endif
+
+    return count;
+} /* readTrace */
+
+
+/* ------------------------------------------------------------------------
+   Name - dumpTrace
+   Purpose - prints the events in the trace ring, oldest first
+   Parameters - none
+   Returns - nothing
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+void dumpTrace() {
+#if SCHEDTRACE
+    static char *names[] = {"fork", "switch", "quit", "block", "unblock", "zap"};
+    static char *others[] = {"parent", "to", "status", "status", "by", "target"};
+    unsigned int i;
+
+    i = traceNext < TRACESIZE ? 0 : traceNext - TRACESIZE;
+
+    USLOSS_Console("Trace of the last %d scheduler events\n", traceNext - i);
+
+    for ( ; i != traceNext; i++) {
+        traceEvent *event = &TraceRing[i % TRACESIZE];
+
+        USLOSS_Console("%10d\t%-8s pid %5d  %-6s %5d  priority %d\n",
+                       event->time, names[event->type], event->pid,
+                       others[event->type], event->other, event->priority);
+    }
+#endif
+} /* dumpTrace */
+
+
+/* ------------------------------------------------------------------------
+   Name - check_user_mode
    Purpose -
    Parameters -
    Returns -
    Side Effects -
    ------------------------------------------------------------------------ */
-void dumpProcesses() {
-    int i;
+int check_user_mode() {
+    union psrValues current_psr_status;
 
-    printf("PID\tParent  Priority\tStatus\t\t# Kids  CPUtime Name\n");
-
-    for (i = 0; i < MAXPROC; i++) {
-        procStruct current = ProcTable[i];
-        printf("%5d\t", current.pid);
-    	
-    	if (current.parentProcPtr == NULL) {
-    	    printf("%5d\t", -2);	
-    	}
-    	else {
-            printf("%5d\t", current.parentProcPtr->pid);   
-	}
-
-        printf("%10d\t", current.priority);
-        printf("%5d\t", current.status);
-        printf("%8d\t", 5);
-        printf("%5d\t", 10);
-        printf("%s\t\n", current.name);
+    current_psr_status.integerPart = USLOSS_PsrGet();
+
+    // test if in kernel mode, halt if in user mode
+    if (current_psr_status.bits.curMode == 0) {
+        return 1;
     }
-} /* dumpProcesses */
+
+    return 0;
+} /* check_user_mode */
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
+
 
 
 /* ------------------------------------------------------------------------
-   Name - zap
-   Purpose -
-   Parameters -
-   Returns -
-   Side Effects -
+   Name - check_wait_cycle
+   Purpose - called when a process has just blocked in zap, join or on a
+             mutex, this checks whether the new wait-for edges leave it
+             waiting on a set of processes none of which can ever go on.
+             A process can go on if anything it waits on can, a join on
+             any child needing just one child to quit, so the waiter is
+             deadlocked only if nothing it reaches waits on nobody.  The
+             search is depth first, each process visited at most once, and
+             a process still being searched needs no answer of its own:
+             whatever it reaches is reached from the waiter as well.  It
+             stops at the first process found free, looking at a
+             process' direct edges before going deeper, so the usual
+             join of ready children costs one look.
+   Parameters - the process that just blocked
+   Returns - nothing
+   Side Effects - prints a cycle of pids through the waiter and halts
+                  USLOSS on deadlock
    ------------------------------------------------------------------------ */
-int zap(int pid) {
-    procPtr process_to_zap;
+static void check_wait_cycle(procPtr waiter) {
+    procPtr proc, edge;
+    int count = 0;
 
-    process_to_zap = &ProcTable[pid % MAXPROC];
+    waitSearch++;
+    wait_push(waiter, NULL, &count);
 
+    while (count > 0) {
+        proc = WaitNodes[--count];
 
-    // check calling process is not zapped itself
-    if (isZapped()) {
-        return -1;
+        for (edge = wait_first(proc); edge != NULL; edge = wait_next(proc, edge)) {
+            if (wait_first(edge) == NULL) {
+                return;
+            }
+        }
+
+        for (edge = wait_first(proc); edge != NULL; edge = wait_next(proc, edge)) {
+            wait_push(edge, proc, &count);
+        }
     }
 
+    wait_report(waiter);
+} /* check_wait_cycle */
 
-    // check if you tried to zap yourself
-    if (Current->pid == process_to_zap->pid) {
-        USLOSS_Console("zap(): process %d tried to zap itself.  Halting...\n", Current->pid);
-        USLOSS_Halt(1);
-    }
 
+/* ------------------------------------------------------------------------
+   Name - wait_report
+   Purpose - finds the shortest cycle from the waiter back to itself,
+             searching breadth first with each process' waitNext naming
+             the one it was reached from, and prints it.  Everything the
+             waiter reaches is deadlocked, so any path will do.
+   Parameters - the waiter, which check_wait_cycle() found deadlocked
+   Returns - nothing
+   Side Effects - halts USLOSS
+   ------------------------------------------------------------------------ */
+static void wait_report(procPtr waiter) {
+    procPtr last = NULL;
+    procPtr edge;
+    int count = 0;
+    int i;
 
-    // check zapped process exists and that it is not itself
-    if (process_to_zap->status == UNUSED || process_to_zap->pid != pid) {
-        USLOSS_Console("zap(): process being zapped does not exist.  Halting...\n");
-        USLOSS_Halt(1);
+    waitSearch++;
+    wait_push(waiter, NULL, &count);
+
+    for (i = 0; i < count && last == NULL; i++) {
+        for (edge = wait_first(WaitNodes[i]); edge != NULL;
+             edge = wait_next(WaitNodes[i], edge)) {
+            if (edge == waiter) {
+                last = WaitNodes[i];
+                break;
+            }
+            wait_push(edge, WaitNodes[i], &count);
+        }
     }
 
-    
-    // if process has quit then return 0
-    if (process_to_zap->status == QUIT) {
-        return 0;
+    // walk back from the last hop, then print the path the right way round
+    for (count = 0; last != NULL; last = last->waitNext) {
+        WaitNodes[count++] = last;
     }
 
+    USLOSS_Console("Deadlock detected:");
+    for (i = count - 1; i >= 0; i--) {
+        USLOSS_Console(" %d ->", WaitNodes[i]->pid);
+    }
+    USLOSS_Console(" %d. Halting...\n", waiter->pid);
+    USLOSS_Halt(1);
+} /* wait_report */
 
-    // set the statuses
-    process_to_zap->zapped = 1;
-    Current->status = ZAP_BLOCKED;
 
+/* ------------------------------------------------------------------------
+   Name - wait_push
+   Purpose - adds a process to WaitNodes unless the current waitSearch
+             has seen it
+   Parameters - the process, the one it was reached from and where the
+                count of WaitNodes is kept
+   Returns - nothing
+   Side Effects - sets waitMark and waitNext, WaitNodes may grow, halts
+                  if out of memory
+   ------------------------------------------------------------------------ */
+static void wait_push(procPtr proc, procPtr from, int *count) {
+    if (proc->waitMark == waitSearch) {
+        return;
+    }
 
-    // set the zapped pointer to the zapped process
-    Current->zappedProcPtr = process_to_zap;
+    if (*count == waitNodesCapacity) {
+        int capacity = waitNodesCapacity == 0 ? PROCCHUNK : 2 * waitNodesCapacity;
+        procPtr *nodes = realloc(WaitNodes, capacity * sizeof(procPtr));
 
+        if (nodes == NULL) {
+            USLOSS_Console("wait_push(): out of memory.  Halting...\n");
+            USLOSS_Halt(1);
+        }
+        WaitNodes = nodes;
+        waitNodesCapacity = capacity;
+    }
 
-    // add current process to list of zappers, and delete Current off readylist
-    delete_node(&ReadyList[Current->priority], Current, READYLIST);
-    add_node(&process_to_zap->zappersProcPtr, Current, ZAPPERLIST);
+    proc->waitMark = waitSearch;
+    proc->waitNext = from;
+    WaitNodes[(*count)++] = proc;
+} /* wait_push */
 
 
-    dispatcher();
+/* ------------------------------------------------------------------------
+   Name - wait_first
+   Purpose - gives the first wait-for edge of a process: a zapper waits
+             on the process it zapped, a process waiting for a mutex on
+             its owner, and a parent in join on the child it named to
+             joinPid() or else on all of its children.  Processes that
+             are ready, or blocked in blockMe, sleepTicks or semP, may be
+             woken by anyone, so they wait on no one.
+   Parameters - the process
+   Returns - the process it waits on, NULL if none
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+static procPtr wait_first(procPtr proc) {
+    if (proc->status == ZAP_BLOCKED) {
+        return proc->zappedProcPtr;
+    }
 
-    // check calling process is not zapped itself
-    if (isZapped()) {
-        return -1;
+    if (proc->status == MUTEX_BLOCKED) {
+        return find_process(SemTable[proc->semWaiting].ownerPid);
     }
 
-    return 0;
-} /* zap */
+    if (proc->status == JOIN_BLOCKED && proc->joinTarget != NULL) {
+        return proc->joinTarget;
+    }
+
+    if (proc->status == JOIN_BLOCKED) {
+        return proc->childProcPtr;
+    }
+
+    return NULL;
+} /* wait_first */
 
 
 /* ------------------------------------------------------------------------
-   Name - isZapped
-   Purpose - 
-   Parameters -
-   Returns -
-   Side Effects -
+   Name - wait_next
+   Purpose - gives the wait-for edge of a process after the one given,
+             only a join on any child has more than one
+   Parameters - the process and its current edge
+   Returns - the next process it waits on, NULL if none
+   Side Effects - none
    ------------------------------------------------------------------------ */
-int isZapped() {
-    return Current->zapped;
-} /* isZapped */
+static procPtr wait_next(procPtr proc, procPtr edge) {
+    if (proc->status == JOIN_BLOCKED && proc->joinTarget == NULL) {
+        return edge->nextSiblingPtr;
+    }
+
+    return NULL;
+} /* wait_next */
 
 
 /* ------------------------------------------------------------------------
-   Name - getPid
-   Purpose -
-   Parameters -
-   Returns -
-   Side Effects -
+   Name - set_status
+   Purpose - changes a process' status, keeping statusCount up to date so
+             the sentinel and dumpProcesses() need not walk the table
+   Parameters - the process and its new status
+   Returns - nothing
+   Side Effects - statusCount changes
    ------------------------------------------------------------------------ */
-int getpid() {
-    return Current->pid;
-} /* getpid */
+static void set_status(procPtr proc, int status) {
+    statusCount[status_class(proc->status)]--;
+    statusCount[status_class(status)]++;
+    proc->status = status;
+} /* set_status */
 
 
 /* ------------------------------------------------------------------------
-   Name - blockMe
-   Purpose -
-   Parameters -
-   Returns -
-   Side Effects -
+   Name - status_class
+   Purpose - maps a status to its statusCount entry, sleepers and blockMe
+             statuses are all counted as BLOCKED
+   Parameters - the status
+   Returns - the statusCount index
+   Side Effects - none
    ------------------------------------------------------------------------ */
-int blockMe(int newStatus) {
+static int status_class(int status) {
+    if (status > ZAP_BLOCKED) {
+        return BLOCKED;
+    }
 
-    // halt and print error message if newstatus is not a block status
-    if (newStatus < 10) {
-        USLOSS_Console("blockMe(): newStatus parameter is less than 10.\n");
-        USLOSS_Halt(1);
+    return status;
+} /* status_class */
+
+
+/* ------------------------------------------------------------------------
+   Name - tick_needed
+   Purpose - tells whether a clock tick has work to do: sleepers to wake,
+             a time slice to end for another ready process at the current
+             priority, or MLFQ demotions and SCHED_FAIR vruntime, which
+             both need time charged as it passes
+   Parameters - none
+   Returns - 1 if the tick is needed, 0 if it may be skipped
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+static int tick_needed(void) {
+    if (sleepCount > 0) {
+        return 1;
     }
 
-    
-    // process attempted to block while zapped
-    if (isZapped()) {
-        return -1;
+    if (Current == NULL || timeSliceQuantum == 0) {
+        return 0;
     }
 
+    if (schedPolicy != SCHED_FIXED) {
+        return 1;
+    }
 
-    // change status and take off the ReadyList
-    disableInterrupts();
-    Current->status = newStatus;
-    delete_node(&ReadyList[Current->priority], Current, READYLIST);
+    // Current stays on its ReadyList while it runs
+    return ReadyList[Current->priority] != ReadyTail[Current->priority];
+} /* tick_needed */
 
 
-    // call dispatcher then check if process was zapped while blocked
-    dispatcher();
+/* ------------------------------------------------------------------------
+   Name - timer_insert
+   Purpose - puts a sleeper in the timer wheel.  It goes on the lowest
+             level whose slots, counted from timerNow, reach its wakeTick,
+             so each level only holds the next WHEELSLOTS slots' worth.
+             Sleeps past the top level are parked in its furthest slot
+             and reinserted from there.
+   Parameters - the sleeping process
+   Returns - nothing
+   Side Effects - the process' timerLevel and timerSlot are set
+   ------------------------------------------------------------------------ */
+static void timer_insert(procPtr proc) {
+    int level = 0;
+    unsigned int slot = proc->wakeTick;
 
-    if (isZapped()) {
-        return -1;
+    while ((slot - (timerNow >> (WHEELBITS * level))) >= WHEELSLOTS) {
+        if (level == WHEELLEVELS - 1) {
+            slot = (timerNow >> (WHEELBITS * level)) + WHEELSLOTS - 1;
+            break;
+        }
+        level++;
+        slot = proc->wakeTick >> (WHEELBITS * level);
     }
 
-    return 0;
-} /* blockMe */
-
-
+    proc->timerLevel = level;
+    proc->timerSlot = slot & (WHEELSLOTS - 1);
+    add_node(&TimerWheel[level][proc->timerSlot],
+             &TimerTail[level][proc->timerSlot], proc, SLEEPLIST);
+} /* timer_insert */
 
 
 /* ------------------------------------------------------------------------
-   Name - unblockProc
-   Purpose -
-   Parameters -
-   Returns -
-   Side Effects -
+   Name - timer_cancel
+   Purpose - takes a sleeper off the timer wheel
+   Parameters - the sleeping process
+   Returns - nothing
+   Side Effects - sleepCount goes down
    ------------------------------------------------------------------------ */
-int unblockProc(int pid) {
-    disableInterrupts();
-    unblockRegularProc(pid);
-    dispatcher();
-
-    return 0;
-} /* unblockProc */
+static void timer_cancel(procPtr proc) {
+    delete_node(&TimerWheel[proc->timerLevel][proc->timerSlot],
+                &TimerTail[proc->timerLevel][proc->timerSlot], proc, SLEEPLIST);
+    sleepCount--;
+} /* timer_cancel */
 
 
 /* ------------------------------------------------------------------------
-   Name - unblockRegularProc
-   Purpose -
-   Parameters -
-   Returns -
-   Side Effects -
+   Name - timer_tick
+   Purpose - moves the timer wheel on one clock interrupt.  Each time a
+             level's slots wrap, the next slot of the level above is
+             spread over the levels below, then the level 0 slot for the
+             new tick is woken.  A sleeper is moved at most WHEELLEVELS
+             times, so the work per tick does not grow with the number of
+             sleepers.
+   Parameters - none
+   Returns - the number of sleepers woken
+   Side Effects - woken processes are put back on the ReadyList
    ------------------------------------------------------------------------ */
-int unblockRegularProc(int pid) {
-    procPtr process_to_unblock;
+static int timer_tick(void) {
+    int level;
+    int woken = 0;
+    procPtr *slot;
 
-    process_to_unblock = &ProcTable[pid % MAXPROC];
+    timerNow++;
 
-    // change the status of the process to READY and put it into the ReadyList
-    process_to_unblock->status = READY;
-    add_node(&ReadyList[process_to_unblock->priority], process_to_unblock, READYLIST);
+    for (level = 1; level < WHEELLEVELS &&
+         (timerNow & ((1u << (WHEELBITS * level)) - 1)) == 0; level++) {
+        timer_cascade(level);
+    }
 
+    slot = &TimerWheel[0][timerNow & (WHEELSLOTS - 1)];
+    while (*slot != NULL) {
+        procPtr sleeper = *slot;
 
-    return 0;
-} /* unblockRegularProc */
+        timer_cancel(sleeper);
+        unblockRegularProc(sleeper->pid);
+        woken++;
+    }
+
+    return woken;
+} /* timer_tick */
 
 
 /* ------------------------------------------------------------------------
-   Name - timeSlice
-   Purpose -
-   Parameters -
-   Returns -
-   Side Effects -
+   Name - timer_cascade
+   Purpose - reinserts the sleepers of the current slot of a level, which
+             all fall due within that slot's span, into the levels below
+   Parameters - the level
+   Returns - nothing
+   Side Effects - sleepers move to lower levels of the timer wheel
    ------------------------------------------------------------------------ */
-void timeSlice() {
-    // int current_time = USLOSS_Clock();
+static void timer_cascade(int level) {
+    int slot = (timerNow >> (WHEELBITS * level)) & (WHEELSLOTS - 1);
 
-    // if (Current->time_slice_start - current_time > 80) {
-    //     dispatcher();
-    // }
-} /* timeSlice */
+    while (TimerWheel[level][slot] != NULL) {
+        procPtr sleeper = TimerWheel[level][slot];
 
+        delete_node(&TimerWheel[level][slot], &TimerTail[level][slot],
+                    sleeper, SLEEPLIST);
+        timer_insert(sleeper);
+    }
+} /* timer_cascade */
 
 
 /* ------------------------------------------------------------------------
-   Name - readtime
-   Purpose -
-   Parameters -
-   Returns -
-   Side Effects -
+   Name - block_current
+   Purpose - blocks the current process with the given status, leaving
+             the caller to call the dispatcher
+   Parameters - the status to block with
+   Returns - nothing
+   Side Effects - the process leaves the ReadyList
    ------------------------------------------------------------------------ */
-int readtime() {
-    return Current->total_time_used + readCurStartTime();
-} /* readtime */
-
+static void block_current(int status) {
+    set_status(Current, status);
+    remove_from_readylist(Current);
+
+    // waiting instead of computing earns a level back under MLFQ
+    if (schedPolicy == SCHED_MLFQ && Current->own_priority > Current->base_priority) {
+        Current->own_priority--;
+        refresh_priority(Current);
+    }
+    TRACE(TRACE_BLOCK, Current->pid, status, Current->priority);
+} /* block_current */
 
 
 /* ------------------------------------------------------------------------
-   Name - check_user_mode
-   Purpose -
-   Parameters -
-   Returns -
-   Side Effects -
+   Name - sem_lookup
+   Purpose - finds a semaphore or mutex in use by its id
+   Parameters - the id, and 1 for a mutex or 0 for a semaphore
+   Returns - the semaphore, NULL if the id is not one in use of that kind
+   Side Effects - none
    ------------------------------------------------------------------------ */
-int check_user_mode() {
-    union psrValues current_psr_status;
+static semStruct *sem_lookup(int id, int is_mutex) {
+    if (id < 0 || id >= MAXSEMS || !SemTable[id].inUse ||
+        SemTable[id].isMutex != is_mutex) {
+        return NULL;
+    }
 
-    current_psr_status.integerPart = USLOSS_PsrGet();
+    return &SemTable[id];
+} /* sem_lookup */
 
-    // test if in kernel mode, halt if in user mode
-    if (current_psr_status.bits.curMode == 0) {
-        return 1;
-    }
 
-    return 0;
-} /* check_user_mode */
+/* ------------------------------------------------------------------------
+   Name - sem_create
+   Purpose - takes an unused entry of SemTable for a semaphore or mutex
+   Parameters - the semaphore's starting count, and 1 for a mutex
+   Returns - the id, -1 if none are free or the count is negative
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+static int sem_create(int value, int is_mutex) {
+    int id;
 
+    if (freeSemCount == 0 || value < 0) {
+        return -1;
+    }
 
+    id = freeSems[--freeSemCount];
+    SemTable[id].inUse = 1;
+    SemTable[id].isMutex = is_mutex;
+    SemTable[id].value = value;
+    SemTable[id].ownerPid = -1;
+    SemTable[id].waitHead = NULL;
+    SemTable[id].waitTail = NULL;
 
+    return id;
+} /* sem_create */
 
 
+/* ------------------------------------------------------------------------
+   Name - sem_free
+   Purpose - returns a semaphore or mutex nobody waits on to the free stack
+   Parameters - the id, and 1 for a mutex or 0 for a semaphore
+   Returns - 0 if freed, -1 if it is not in use or has waiters
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+static int sem_free(int id, int is_mutex) {
+    semStruct *sem = sem_lookup(id, is_mutex);
+
+    if (sem == NULL || sem->waitHead != NULL) {
+        return -1;
+    }
 
+    sem->inUse = 0;
+    freeSems[freeSemCount++] = id;
 
+    return 0;
+} /* sem_free */
 
 
+/* ------------------------------------------------------------------------
+   Name - sem_wait
+   Purpose - queues the current process on a semaphore or mutex and blocks
+             it until sem_handoff() hands it over
+   Parameters - the semaphore, its id, and the status to block with
+   Returns - nothing
+   Side Effects - the dispatcher runs other processes meanwhile
+   ------------------------------------------------------------------------ */
+static void sem_wait(semStruct *sem, int id, int status) {
+    Current->semWaiting = id;
+    add_node(&sem->waitHead, &sem->waitTail, Current, SEMLIST);
+    block_current(status);
+
+    // the mutex's owner may, in the end, be waiting on us
+    if (status == MUTEX_BLOCKED) {
+        check_wait_cycle(Current);
+    }
 
+    dispatcher();
+} /* sem_wait */
 
 
+/* ------------------------------------------------------------------------
+   Name - sem_handoff
+   Purpose - gives a released semaphore or mutex to its first waiter, and
+             only switches to the waiter if it outranks the caller
+   Parameters - the semaphore, which must have a waiter
+   Returns - nothing
+   Side Effects - the waiter is unblocked, the dispatcher may run
+   ------------------------------------------------------------------------ */
+static void sem_handoff(semStruct *sem) {
+    procPtr waiter = sem->waitHead;
 
+    delete_node(&sem->waitHead, &sem->waitTail, waiter, SEMLIST);
+    waiter->semWaiting = -1;
 
+    if (sem->isMutex) {
+        sem->ownerPid = waiter->pid;
+    }
 
+    unblockRegularProc(waiter->pid);
+    maybe_dispatch();
+} /* sem_handoff */
 
 
+/* ------------------------------------------------------------------------
+   Name - should_preempt
+   Purpose - tells whether a process that was just made ready could run
+             instead of the current one.  Under the fixed and MLFQ
+             policies only a strictly better priority does, so equal
+             priorities keep their round robin order.  SCHED_FAIR always
+             lets the dispatcher decide on vruntime.
+   Parameters - none
+   Returns - 1 if the dispatcher should run, 0 if Current keeps the CPU
+   Side Effects - none
+   ------------------------------------------------------------------------ */
+static int should_preempt(void) {
+    if (Current == NULL || Current->status != READY) {
+        return 1;
+    }
 
+    if (schedPolicy == SCHED_FAIR && fairCount > 0) {
+        return 1;
+    }
 
+    return readyBitmap != 0 && ffs(readyBitmap) - 1 < Current->priority;
+} /* should_preempt */
 
 
+/* ------------------------------------------------------------------------
+   Name - maybe_dispatch
+   Purpose - calls the dispatcher if should_preempt() says so, counting
+             the calls made and skipped
+   Parameters - none
+   Returns - 1 if the dispatcher ran, 0 if it was skipped
+   Side Effects - may switch to another process
+   ------------------------------------------------------------------------ */
+static int maybe_dispatch(void) {
+    if (!should_preempt()) {
+        dispatchesElided++;
+        return 0;
+    }
 
+    dispatchesPerformed++;
+    dispatcher();
+    return 1;
+} /* maybe_dispatch */
@@ -8,7 +8,7 @@
 #include <usloss.h>
 
 /*
- * Maximum number of processes. 
+ * Default maximum number of processes, see setProcLimit().
  */
 
 #define MAXPROC      50
@@ -25,6 +25,19 @@
 
 #define MAXARG       100
 
+/*
+ * Maximum number of semaphores and mutexes in use at once
+ */
+
+#define MAXSEMS      200
+
+/*
+ * Priorities run from 1 (highest) to 6 (the sentinel), arrays indexed by
+ * priority leave 0 unused
+ */
+
+#define AMOUNTPRIORITIES 7
+
 /*
  * Maximum number of syscalls.
  */
@@ -35,7 +48,72 @@
  * Enumeration to specify from which list to delete from
  */
 
-typedef enum {READYLIST, QUITLIST, CHILDRENLIST, ZAPPERLIST} list_to_change; 
+typedef enum {READYLIST, QUITLIST, CHILDRENLIST, ZAPPERLIST,
+              SLEEPLIST, SEMLIST} list_to_change; 
+
+/*
+ * Scheduler trace events, see readTrace() and dumpTrace().  other holds
+ * the parent pid for a fork, the new pid for a switch, the exit status
+ * for a quit, the block status for a block, the waking pid for an
+ * unblock and the target pid for a zap.
+ */
+
+typedef enum {TRACE_FORK, TRACE_SWITCH, TRACE_QUIT, TRACE_BLOCK,
+              TRACE_UNBLOCK, TRACE_ZAP} trace_type;
+
+typedef struct traceEvent {
+    int     time;       /* USLOSS_Clock() when the event happened */
+    short   type;       /* a trace_type */
+    short   priority;
+    int     pid;
+    int     other;
+} traceEvent;
+
+/*
+ * Process table dumps, see dumpProcessesFiltered().  A status, priority or
+ * rootPid of -1 matches every process, rootPid otherwise keeps only that
+ * process and its descendants.
+ */
+
+typedef enum {DUMP_TABLE, DUMP_CSV, DUMP_JSON} dump_format;
+
+typedef struct dumpFilter {
+    int     status;     /* only processes with this status */
+    int     priority;   /* only processes at this priority */
+    int     rootPid;    /* only processes in this pid's subtree */
+    int     format;     /* a dump_format */
+} dumpFilter;
+
+/*
+ * Cumulative kernel counters, see getKernelStats().  readyDepth counts the
+ * processes ready at each priority, the running one included, and
+ * readyPeak the most there have been since the last reset.
+ */
+
+typedef struct kernelStats {
+    int     forks;              /* processes created by fork1() */
+    int     failedForks;        /* fork1() calls that returned -1 or -2 */
+    int     quits;
+    int     joins;              /* children reaped by join(), joinPid()
+                                   and joinAll() */
+    int     zaps;               /* processes zapped by zap() and zapMany() */
+    int     blocks;             /* blockMe() calls */
+    int     unblocks;           /* unblockProc() calls */
+    int     switches;           /* dispatches that changed processes */
+    int     readyPicks;         /* dispatches that picked off a ReadyList */
+    int     readyInspected;     /* ReadyList entries those picks looked at,
+                                   equal to readyPicks as only the head of
+                                   a list is ever looked at */
+    int     clockInterrupts;
+    int     readyDepth[AMOUNTPRIORITIES];
+    int     readyPeak[AMOUNTPRIORITIES];
+} kernelStats;
+
+/*
+ * Scheduling policies, see setSchedPolicy().
+ */
+
+typedef enum {SCHED_FIXED, SCHED_MLFQ, SCHED_FAIR} sched_policy;
 
 /* 
  * Function prototypes for this phase.
@@ -44,22 +122,50 @@ typedef enum {READYLIST, QUITLIST, CHILDRENLIST, ZAPPERLIST} list_to_change;
 extern int   fork1(char *name, int(*func)(char *), char *arg,
                    int stacksize, int priority);
 extern int   join(int *status);
+extern int   joinPid(int pid, int *status);
+extern int   joinAll(int *statuses, int max);
 extern void  quit(int status);
 extern int   zap(int pid);
+extern int   zapMany(int *pids, int n);
 extern int   isZapped(void);
 extern int   getpid(void);
 extern void  dumpProcesses(void);
+extern int   dumpProcessesFiltered(dumpFilter *filter);
+extern int   readTrace(traceEvent *events, int max);
+extern void  dumpTrace(void);
+extern int   setProcLimit(int limit);
 extern int   blockMe(int block_status);
+extern int   sleepTicks(int ticks);
+extern int   sleepUs(int us);
+extern int   semCreate(int value);
+extern int   semFree(int sem);
+extern int   semP(int sem);
+extern int   semV(int sem);
+extern int   mutexCreate(void);
+extern int   mutexFree(int mutex);
+extern int   mutexLock(int mutex);
+extern int   mutexUnlock(int mutex);
 extern int   unblockProc(int pid);
 extern int   unblockRegularProc(int pid);
 extern int   readCurStartTime(void);
 extern void  timeSlice(void);
+extern int   setTimeSlice(int quantum);
+extern int   setSchedPolicy(int policy);
+extern int   setPriorityInheritance(int on);
+extern int   setTickless(int on);
+extern void  readClockStats(int *interrupts, int *skipped);
+extern void  readDispatchStats(int *elided, int *performed);
+extern void  getKernelStats(kernelStats *stats, int reset);
 extern void  dispatcher(void);
 extern int   readtime(void);
+extern int   setStackPoolCap(int cap);
+extern void  readStackPoolStats(int *hits, int *misses);
 extern void  clock_interrupt_handler(int dev, void *arg);
 extern int   check_user_mode();
 extern void  disableInterrupts();
 extern void  enableInterrupts();
+extern int   irqSave(void);
+extern void  irqRestore(int flags);
 
 extern void  p1_fork(int pid);
 extern void  p1_quit(int pid);
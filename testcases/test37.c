@@ -0,0 +1,41 @@
+/* start1 forks two children and joins on either of them.  Each child
+ * then zaps start1, so start1 waits on children that wait on it.  The
+ * second zap closes the cycle and the deadlock is reported at once.
+ */
+
+#include <stdio.h>
+#include <usloss.h>
+#include <phase1.h>
+
+int XXp1(char *);
+int parentPid;
+
+int start1(char *args)
+{
+    int status, pid;
+
+    parentPid = getpid();
+    USLOSS_Console("start1(): started\n");
+
+    pid = fork1("XXp1", XXp1, "XXp1", USLOSS_MIN_STACK, 3);
+    USLOSS_Console("start1(): after fork of child %d\n", pid);
+
+    pid = fork1("XXp1", XXp1, "XXp1", USLOSS_MIN_STACK, 3);
+    USLOSS_Console("start1(): after fork of child %d\n", pid);
+
+    USLOSS_Console("start1(): performing join\n");
+    pid = join(&status);
+    USLOSS_Console("start1(): should not get here, join returned %d\n", pid);
+
+    return 0;
+} /* start1 */
+
+int XXp1(char *arg)
+{
+    USLOSS_Console("XXp1(): %d zapping start1\n", getpid());
+    zap(parentPid);
+    USLOSS_Console("XXp1(): should not get here\n");
+
+    quit(-3);
+    return 0;
+} /* XXp1 */